@@ -0,0 +1,26 @@
+#ifndef MLIBC_BENCH_H
+#define MLIBC_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Prevents the compiler from optimizing away accesses to the given memory.
+static inline void bench_clobber(const void *p) {
+	__asm__ volatile ("" : : "r"(p) : "memory");
+}
+
+// Results are printed one per line as tab-separated fields:
+// <benchmark> <parameter> <value> <unit>
+static inline void bench_report(const char *name, size_t param, double value, const char *unit) {
+	printf("%s\t%zu\t%.3f\t%s\n", name, param, value, unit);
+}
+
+#endif // MLIBC_BENCH_H
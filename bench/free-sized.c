@@ -0,0 +1,56 @@
+#include <stdlib.h>
+
+#include "bench.h"
+
+#ifdef USE_HOST_LIBC
+// free_sized() is only available in recent glibc versions.
+void free_sized(void *ptr, size_t size) __attribute__((weak));
+#endif
+
+#define BATCH 1024
+#define ROUNDS 2000
+
+static void *blocks[BATCH];
+
+// Average time of a malloc() / free() pair when allocating and releasing
+// batches of small blocks, with either free() or free_sized().
+static void bench_churn(size_t size, int sized) {
+	uint64_t best = UINT64_MAX;
+
+	for(int repeat = 0; repeat < 5; repeat++) {
+		uint64_t start = bench_now_ns();
+		for(int round = 0; round < ROUNDS; round++) {
+			for(size_t i = 0; i < BATCH; i++) {
+				blocks[i] = malloc(size);
+				bench_clobber(blocks[i]);
+			}
+			if(sized) {
+				for(size_t i = 0; i < BATCH; i++)
+					free_sized(blocks[i], size);
+			}else{
+				for(size_t i = 0; i < BATCH; i++)
+					free(blocks[i]);
+			}
+		}
+		uint64_t elapsed = bench_now_ns() - start;
+		if(elapsed < best)
+			best = elapsed;
+	}
+
+	bench_report(sized ? "churn-free-sized" : "churn-free", size,
+			(double)best / ((uint64_t)ROUNDS * BATCH), "ns");
+}
+
+int main() {
+	size_t sizes[] = {16, 64, 256, 1024};
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		bench_churn(sizes[i], 0);
+#ifdef USE_HOST_LIBC
+		if(!free_sized)
+			continue;
+#endif
+		bench_churn(sizes[i], 1);
+	}
+	return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define HEAP_SIZE ((size_t)256 << 20)
+#define STEPS 20000000
+
+// Run with MLIBC_MALLOC_HUGEPAGES=1 to compare against transparent huge pages;
+// TLB misses can be observed with e.g. perf stat -e dTLB-load-misses.
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15;
+
+static uint64_t rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+// Allocates HEAP_SIZE bytes in blocks of the given size, links them into a random
+// cycle and measures the time per step when following the cycle.
+static void bench_chase(size_t block_size) {
+	size_t count = HEAP_SIZE / block_size;
+	void **blocks = malloc(count * sizeof(void *));
+
+	uint64_t start = bench_now_ns();
+	for(size_t i = 0; i < count; i++) {
+		blocks[i] = malloc(block_size);
+		memset(blocks[i], 0, block_size);
+	}
+	uint64_t alloc_time = bench_now_ns() - start;
+
+	// Sattolo's algorithm yields a single cycle through all blocks.
+	size_t *order = malloc(count * sizeof(size_t));
+	for(size_t i = 0; i < count; i++)
+		order[i] = i;
+	for(size_t i = count - 1; i > 0; i--) {
+		size_t j = rng_next() % i;
+		size_t tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for(size_t i = 0; i < count; i++)
+		*(void **)blocks[i] = blocks[order[i]];
+	free(order);
+
+	void *p = blocks[0];
+	start = bench_now_ns();
+	for(size_t i = 0; i < STEPS; i++)
+		p = *(void **)p;
+	uint64_t chase_time = bench_now_ns() - start;
+	bench_clobber(p);
+
+	for(size_t i = 0; i < count; i++)
+		free(blocks[i]);
+	free(blocks);
+
+	bench_report("heap-alloc", block_size, (double)alloc_time / count, "ns");
+	bench_report("heap-chase", block_size, (double)chase_time / STEPS, "ns");
+}
+
+int main() {
+	bench_chase(64);
+	bench_chase(256);
+	bench_chase(1024);
+	bench_chase(4096);
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define ROUNDS 5
+
+// Time of a single realloc() when doubling a buffer, per target size.
+static void bench_doubling(void) {
+	enum { min_shift = 12, max_shift = 28 };
+	uint64_t best[max_shift + 1];
+	for(int i = 0; i <= max_shift; i++)
+		best[i] = UINT64_MAX;
+
+	for(int round = 0; round < ROUNDS; round++) {
+		size_t size = (size_t)1 << min_shift;
+		char *buf = malloc(size);
+		memset(buf, 1, size);
+		for(int shift = min_shift + 1; shift <= max_shift; shift++) {
+			size_t new_size = (size_t)1 << shift;
+			uint64_t start = bench_now_ns();
+			buf = realloc(buf, new_size);
+			uint64_t elapsed = bench_now_ns() - start;
+			bench_clobber(buf);
+			if(elapsed < best[shift])
+				best[shift] = elapsed;
+
+			// Touch the new part such that the next round has to move real contents.
+			memset(buf + size, 1, new_size - size);
+			size = new_size;
+		}
+		free(buf);
+	}
+
+	for(int shift = min_shift + 1; shift <= max_shift; shift++)
+		bench_report("realloc-double", (size_t)1 << shift, best[shift], "ns");
+}
+
+// Average time of realloc() when growing a buffer in small steps.
+static void bench_increments(size_t step, size_t limit) {
+	uint64_t best = UINT64_MAX;
+	size_t steps = limit / step;
+
+	for(int round = 0; round < ROUNDS; round++) {
+		char *buf = NULL;
+		uint64_t total = 0;
+		for(size_t size = step; size <= limit; size += step) {
+			uint64_t start = bench_now_ns();
+			buf = realloc(buf, size);
+			total += bench_now_ns() - start;
+			buf[size - 1] = 1;
+		}
+		free(buf);
+		if(total < best)
+			best = total;
+	}
+
+	bench_report("realloc-increment", step, (double)best / steps, "ns");
+}
+
+int main() {
+	bench_doubling();
+	bench_increments(4096, (size_t)64 << 20);
+	bench_increments(65536, (size_t)256 << 20);
+	return 0;
+}
@@ -145,11 +145,12 @@ void *calloc(size_t count, size_t size) {
 		return NULL;
 	}
 
-	// TODO: this could be done more efficient if the OS gives us already zero'd pages
-	void *ptr = malloc(count * size);
-	if(!ptr)
-		return nullptr;
-	memset(ptr, 0, count * size);
+	// Large blocks are mapped directly and are not touched, as the OS already zeroes them.
+	auto ptr = getAllocator().allocate_zeroed(count * size);
+	// TODO: Print PID only if POSIX option is enabled.
+	if (mlibc::globalConfig().debugMalloc)
+		mlibc::infoLogger() << "mlibc (PID ?): calloc() returns "
+				<< ptr << frg::endlog;
 	return ptr;
 }
 // free() is provided by the platform
@@ -478,6 +479,25 @@ void free(void *ptr) {
 	getAllocator().free(ptr);
 }
 
+void free_sized(void *ptr, size_t size) {
+	// TODO: Print PID only if POSIX option is enabled.
+	if (mlibc::globalConfig().debugMalloc)
+		mlibc::infoLogger() << "mlibc (PID ?): free_sized() on "
+				<< ptr << " with size " << size << frg::endlog;
+	getAllocator().deallocate(ptr, size);
+}
+
+void free_aligned_sized(void *ptr, size_t alignment, size_t size) {
+	// TODO: Print PID only if POSIX option is enabled.
+	if (mlibc::globalConfig().debugMalloc)
+		mlibc::infoLogger() << "mlibc (PID ?): free_aligned_sized() on "
+				<< ptr << " with alignment " << alignment << " and size " << size << frg::endlog;
+	// aligned_alloc() raises the alignment in the same way.
+	if (alignment < sizeof(void *))
+		alignment = sizeof(void *);
+	getAllocator().deallocate_aligned(ptr, size, alignment);
+}
+
 void *malloc(size_t size) {
 	auto nptr = getAllocator().allocate(size);
 	// TODO: Print PID only if POSIX option is enabled.
@@ -501,12 +521,9 @@ int posix_memalign(void **out, size_t align, size_t size) {
 		return EINVAL;
 	if(align & (align - 1)) // Make sure that align is a power of two.
 		return EINVAL;
-	auto p = getAllocator().allocate(frg::max(align, size));
+	auto p = getAllocator().allocate_aligned(size, align);
 	if(!p)
 		return ENOMEM;
-	// Hope that the alignment was respected. This works on the current allocator.
-	// TODO: Make the allocator alignment-aware.
-	__ensure(!(reinterpret_cast<uintptr_t>(p) & (align - 1)));
 	*out = p;
 	return 0;
 }
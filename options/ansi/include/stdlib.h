@@ -61,6 +61,8 @@ void srand(unsigned int __seed);
 void *aligned_alloc(size_t __alignment, size_t __size);
 void *calloc(size_t __count, size_t __size);
 void free(void *__pointer);
+void free_sized(void *__pointer, size_t __size);
+void free_aligned_sized(void *__pointer, size_t __alignment, size_t __size);
 void *malloc(size_t __size);
 void *realloc(void *__pointer, size_t __size);
 
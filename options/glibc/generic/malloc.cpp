@@ -1,6 +1,135 @@
 #include <bits/glibc/glibc_malloc.h>
+#include <errno.h>
+#include <stdio.h>
 #include <mlibc/allocator.hpp>
 
+namespace {
+
+struct StatTotals {
+	size_t mapped;
+	size_t inUse;
+	size_t cached;
+	size_t free;
+	size_t cachedBlocks;
+	size_t freeBlocks;
+};
+
+StatTotals sumStats(const AllocatorStats &stats) {
+	StatTotals totals{};
+	for(size_t i = 0; i < stats.numSizeClasses; i++) {
+		auto &sc = stats.sizeClasses[i];
+		totals.mapped += sc.mappedBytes;
+		totals.inUse += sc.inUseBytes;
+		totals.cached += sc.cachedBytes;
+		totals.free += sc.freeBytes;
+		totals.cachedBlocks += sc.cachedBytes / sc.blockSize;
+		totals.freeBlocks += sc.freeBytes / sc.blockSize;
+	}
+	return totals;
+}
+
+struct mallinfo2 getMallinfo() {
+	AllocatorStats stats;
+	getAllocator().get_stats(stats);
+	auto totals = sumStats(stats);
+
+	struct mallinfo2 info{};
+	info.arena = totals.mapped + stats.largeBytes;
+	info.ordblks = totals.freeBlocks;
+	info.smblks = totals.cachedBlocks;
+	info.hblks = stats.directCount;
+	info.hblkhd = stats.directBytes;
+	info.fsmblks = totals.cached;
+	info.uordblks = totals.inUse + stats.largeBytes;
+	info.fordblks = totals.free;
+	return info;
+}
+
+} // namespace
+
 size_t malloc_usable_size(void *p) {
 	return getAllocator().get_size(p);
 }
+
+int malloc_trim(size_t) {
+	return getAllocator().trim() ? 1 : 0;
+}
+
+struct mallinfo2 mallinfo2(void) {
+	return getMallinfo();
+}
+
+// Like glibc, the legacy interface truncates the counters to int.
+struct mallinfo mallinfo(void) {
+	auto info = getMallinfo();
+	struct mallinfo legacy;
+	legacy.arena = static_cast<int>(info.arena);
+	legacy.ordblks = static_cast<int>(info.ordblks);
+	legacy.smblks = static_cast<int>(info.smblks);
+	legacy.hblks = static_cast<int>(info.hblks);
+	legacy.hblkhd = static_cast<int>(info.hblkhd);
+	legacy.usmblks = static_cast<int>(info.usmblks);
+	legacy.fsmblks = static_cast<int>(info.fsmblks);
+	legacy.uordblks = static_cast<int>(info.uordblks);
+	legacy.fordblks = static_cast<int>(info.fordblks);
+	legacy.keepcost = static_cast<int>(info.keepcost);
+	return legacy;
+}
+
+void malloc_stats(void) {
+	AllocatorStats stats;
+	getAllocator().get_stats(stats);
+	auto totals = sumStats(stats);
+
+	fprintf(stderr, "system bytes     = %10zu\n",
+			totals.mapped + stats.largeBytes + stats.directBytes);
+	fprintf(stderr, "in use bytes     = %10zu\n",
+			totals.inUse + stats.largeBytes + stats.directBytes);
+	fprintf(stderr, "max mmap regions = %10zu\n", stats.directCount);
+	fprintf(stderr, "max mmap bytes   = %10zu\n", stats.directBytes);
+	for(size_t i = 0; i < stats.numSizeClasses; i++) {
+		auto &sc = stats.sizeClasses[i];
+		fprintf(stderr, "size %5zu: mapped %zu, in use %zu, cached %zu, free %zu, contended %zu\n",
+				sc.blockSize, sc.mappedBytes, sc.inUseBytes, sc.cachedBytes,
+				sc.freeBytes, sc.contendedLocks);
+	}
+	fprintf(stderr, "large: %zu blocks, %zu bytes\n", stats.largeCount, stats.largeBytes);
+	fprintf(stderr, "purged bytes     = %10zu\n", stats.purgedBytes);
+}
+
+int malloc_info(int options, FILE *fp) {
+	// Like glibc, this returns the error instead of setting errno.
+	if(options)
+		return EINVAL;
+
+	AllocatorStats stats;
+	getAllocator().get_stats(stats);
+	auto totals = sumStats(stats);
+
+	fprintf(fp, "<malloc version=\"1\">\n");
+	fprintf(fp, "<heap nr=\"0\">\n<sizes>\n");
+	for(size_t i = 0; i < stats.numSizeClasses; i++) {
+		auto &sc = stats.sizeClasses[i];
+		fprintf(fp, "  <size from=\"%zu\" to=\"%zu\" total=\"%zu\" count=\"%zu\""
+				" mapped=\"%zu\" inuse=\"%zu\" cached=\"%zu\" contended=\"%zu\"/>\n",
+				sc.blockSize, sc.blockSize, sc.freeBytes, sc.freeBytes / sc.blockSize,
+				sc.mappedBytes, sc.inUseBytes, sc.cachedBytes, sc.contendedLocks);
+	}
+	fprintf(fp, "</sizes>\n");
+	fprintf(fp, "<total type=\"fast\" count=\"%zu\" size=\"%zu\"/>\n",
+			totals.cachedBlocks, totals.cached);
+	fprintf(fp, "<total type=\"rest\" count=\"%zu\" size=\"%zu\"/>\n",
+			totals.freeBlocks, totals.free);
+	fprintf(fp, "<system type=\"current\" size=\"%zu\"/>\n",
+			totals.mapped + stats.largeBytes + stats.directBytes);
+	fprintf(fp, "<aspace type=\"total\" size=\"%zu\"/>\n",
+			totals.mapped + stats.largeBytes + stats.directBytes);
+	fprintf(fp, "</heap>\n");
+	fprintf(fp, "<total type=\"large\" count=\"%zu\" size=\"%zu\"/>\n",
+			stats.largeCount, stats.largeBytes);
+	fprintf(fp, "<total type=\"mmap\" count=\"%zu\" size=\"%zu\"/>\n",
+			stats.directCount, stats.directBytes);
+	fprintf(fp, "<total type=\"purged\" size=\"%zu\"/>\n", stats.purgedBytes);
+	fprintf(fp, "</malloc>\n");
+	return 0;
+}
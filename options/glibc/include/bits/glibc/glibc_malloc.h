@@ -6,12 +6,44 @@ extern "C" {
 #endif
 
 #include <bits/size_t.h>
+#include <stdio.h>
+
+struct mallinfo {
+	int arena;
+	int ordblks;
+	int smblks;
+	int hblks;
+	int hblkhd;
+	int usmblks;
+	int fsmblks;
+	int uordblks;
+	int fordblks;
+	int keepcost;
+};
+
+struct mallinfo2 {
+	size_t arena;
+	size_t ordblks;
+	size_t smblks;
+	size_t hblks;
+	size_t hblkhd;
+	size_t usmblks;
+	size_t fsmblks;
+	size_t uordblks;
+	size_t fordblks;
+	size_t keepcost;
+};
 
 size_t malloc_usable_size(void *__ptr);
+int malloc_trim(size_t __pad);
+
+struct mallinfo mallinfo(void);
+struct mallinfo2 mallinfo2(void);
+void malloc_stats(void);
+int malloc_info(int __options, FILE *__fp);
 
 #ifdef __cplusplus
 }
 #endif
 
 #endif /* _GLIBC_MALLOC_H */
-
@@ -1,14 +1,1159 @@
-
+#include <limits.h>
+#include <new>
 #include <string.h>
+#include <time.h>
 
 #include <bits/ensure.h>
 #include <frg/eternal.hpp>
+#include <frg/mutex.hpp>
 #include <mlibc/allocator.hpp>
-#include <mlibc/internal-sysdeps.hpp>
+#include <mlibc/all-sysdeps.hpp>
+#include <mlibc/global-config.hpp>
+#include <mlibc/thread.hpp>
 #include <internal-config.h>
 
 #if !MLIBC_DEBUG_ALLOCATOR
 
+namespace {
+
+// --------------------------------------------------------
+// Size classes
+// --------------------------------------------------------
+
+// Allocations of up to smallLimit bytes are rounded up to a power of two and
+// carved out of runs that only contain blocks of a single size class.
+// Runs are page aligned, hence every block is naturally aligned to its size.
+constexpr size_t smallMinShift = 4;
+constexpr size_t smallMaxShift = 10;
+constexpr size_t smallLimit = size_t{1} << smallMaxShift;
+constexpr size_t numBins = smallMaxShift - smallMinShift + 1;
+
+constexpr size_t runSize = 0x10000;
+
+// Upper bound on the number of bytes that each thread caches per size class.
+constexpr size_t cacheBytesPerBin = 0x2000;
+
+constexpr size_t binSize(size_t bin) {
+	return size_t{1} << (bin + smallMinShift);
+}
+
+constexpr size_t sizeToBin(size_t size) {
+	if(size <= binSize(0))
+		return 0;
+	return sizeof(unsigned long) * CHAR_BIT - __builtin_clzl(size - 1) - smallMinShift;
+}
+
+// Maximal number of blocks that a thread cache holds for a given bin.
+constexpr size_t binLimit(size_t bin) {
+	size_t limit = cacheBytesPerBin / binSize(bin);
+	if(limit < 8)
+		return 8;
+	if(limit > 64)
+		return 64;
+	return limit;
+}
+
+// Number of blocks that are moved between a thread cache and the central lists at once.
+constexpr size_t binBatch(size_t bin) {
+	return binLimit(bin) / 2;
+}
+
+static_assert(sizeToBin(1) == 0);
+static_assert(sizeToBin(binSize(0)) == 0);
+static_assert(sizeToBin(binSize(0) + 1) == 1);
+static_assert(sizeToBin(smallLimit) == numBins - 1);
+
+struct FreeBlock {
+	FreeBlock *next;
+};
+
+// A page-aligned range of free blocks whose pages (except for the first one) were purged.
+// Spans are carved up like runs.
+struct FreeSpan {
+	FreeSpan *next;
+	uintptr_t limit;
+};
+
+// --------------------------------------------------------
+// PageMap
+// --------------------------------------------------------
+
+// Maps each page that belongs to a run to the bin of that run, each page that
+// belongs to the MemoryPool of an arena other than the first one to that arena,
+// and each page of a direct mapping to directPage.
+// All other pages (including those of the first arena's MemoryPool) map to zero.
+// Nodes are never freed, hence lookups do not need to take any lock.
+struct PageMap {
+	static constexpr size_t pageShift = 12;
+	static constexpr size_t addressBits = sizeof(uintptr_t) == 8 ? 48 : 32;
+	static constexpr size_t leafBits = 12;
+	static constexpr size_t midBits = (addressBits - pageShift - leafBits) / 2;
+	static constexpr size_t rootBits = addressBits - pageShift - leafBits - midBits;
+
+	struct Leaf {
+		uint8_t entries[size_t{1} << leafBits];
+	};
+
+	struct Mid {
+		Leaf *leaves[size_t{1} << midBits];
+	};
+
+	uint8_t lookup(uintptr_t address) {
+		if constexpr (addressBits < sizeof(uintptr_t) * CHAR_BIT) {
+			if(address >> addressBits)
+				return 0;
+		}
+		auto mid = __atomic_load_n(&root[rootIndex(address)], __ATOMIC_ACQUIRE);
+		if(!mid)
+			return 0;
+		auto leaf = __atomic_load_n(&mid->leaves[midIndex(address)], __ATOMIC_ACQUIRE);
+		if(!leaf)
+			return 0;
+		return __atomic_load_n(&leaf->entries[leafIndex(address)], __ATOMIC_RELAXED);
+	}
+
+	void set(uintptr_t address, size_t length, uint8_t value) {
+		for(size_t off = 0; off < length; off += size_t{1} << pageShift) {
+			auto page = address + off;
+			if constexpr (addressBits < sizeof(uintptr_t) * CHAR_BIT)
+				__ensure(!(page >> addressBits));
+
+			auto mid = getOrCreate(&root[rootIndex(page)]);
+			auto leaf = getOrCreate(&mid->leaves[midIndex(page)]);
+			__atomic_store_n(&leaf->entries[leafIndex(page)], value, __ATOMIC_RELAXED);
+		}
+	}
+
+private:
+	static size_t rootIndex(uintptr_t address) {
+		return address >> (pageShift + leafBits + midBits);
+	}
+
+	static size_t midIndex(uintptr_t address) {
+		return (address >> (pageShift + leafBits)) & ((size_t{1} << midBits) - 1);
+	}
+
+	static size_t leafIndex(uintptr_t address) {
+		return (address >> pageShift) & ((size_t{1} << leafBits) - 1);
+	}
+
+	template<typename T>
+	static T *getOrCreate(T **slot) {
+		auto node = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+		if(node)
+			return node;
+
+		// sys_anon_allocate() returns zeroed memory.
+		void *fresh;
+		__ensure(!mlibc::sys_anon_allocate(sizeof(T), &fresh));
+		if(__atomic_compare_exchange_n(slot, &node, static_cast<T *>(fresh),
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return static_cast<T *>(fresh);
+
+		// Another thread won the race.
+		__ensure(!mlibc::sys_anon_free(fresh, sizeof(T)));
+		return node;
+	}
+
+	Mid *root[size_t{1} << rootBits];
+};
+
+// Zero-initialized, hence usable before any constructor runs.
+constinit PageMap pageMap{};
+
+constexpr size_t pageSize = size_t{1} << PageMap::pageShift;
+
+constexpr uint8_t poolPageBit = 0x80;
+constexpr uint8_t directPage = 0x40;
+
+static_assert(numBins < directPage);
+
+constexpr uint8_t runPage(size_t bin) {
+	return bin + 1;
+}
+
+constexpr uint8_t poolPage(unsigned int arena) {
+	return arena ? (poolPageBit | arena) : 0;
+}
+
+// Returns the bin of a block that was carved out of a run, or -1 for other blocks.
+ssize_t entryBin(uint8_t entry) {
+	if(!entry || entry > numBins)
+		return -1;
+	return entry - 1;
+}
+
+// --------------------------------------------------------
+// Huge pages
+// --------------------------------------------------------
+
+// If huge pages are enabled, runs and MemoryPool slabs are carved out of regions
+// that are aligned to hugePageSize and marked with MADV_HUGEPAGE, such that the OS
+// can back them by transparent huge pages. Parts of a region are unmapped and
+// purged individually; the OS splits the affected huge pages as needed.
+constexpr size_t hugePageSize = 0x200000;
+constexpr size_t hugeRegionSize = 16 * hugePageSize;
+
+constinit bool useHugePages = false;
+
+struct HugeRegion {
+	FutexLock lock;
+	uintptr_t cursor = 0;
+	uintptr_t limit = 0;
+};
+
+HugeRegion &getHugeRegion() {
+	static frg::eternal<HugeRegion> region;
+	return region.get();
+}
+
+void adviseHuge(uintptr_t address, size_t length) {
+#if __MLIBC_POSIX_OPTION && defined(MADV_HUGEPAGE)
+	if(mlibc::sys_madvise)
+		mlibc::sys_madvise(reinterpret_cast<void *>(address), length, MADV_HUGEPAGE);
+#else
+	(void)address;
+	(void)length;
+#endif
+}
+
+// Maps length bytes at an address that is aligned to hugePageSize.
+uintptr_t mapHugeAligned(size_t length) {
+	size_t slack = hugePageSize - pageSize;
+	void *ptr;
+	__ensure(!mlibc::sys_anon_allocate(length + slack, &ptr));
+	auto raw = reinterpret_cast<uintptr_t>(ptr);
+	auto base = (raw + hugePageSize - 1) & ~(hugePageSize - 1);
+
+	if(base != raw)
+		__ensure(!mlibc::sys_anon_free(ptr, base - raw));
+	if(auto tail = raw + length + slack - (base + length); tail)
+		__ensure(!mlibc::sys_anon_free(reinterpret_cast<void *>(base + length), tail));
+
+	adviseHuge(base, length);
+	return base;
+}
+
+uintptr_t mapHugePages(size_t length) {
+	if(length >= hugeRegionSize / 2)
+		return mapHugeAligned(length);
+
+	auto &region = getHugeRegion();
+	frg::unique_lock lock(region.lock);
+	if(region.limit - region.cursor < length) {
+		// Give the rest of the old region back; it is too small to be useful.
+		if(region.cursor != region.limit)
+			__ensure(!mlibc::sys_anon_free(reinterpret_cast<void *>(region.cursor),
+					region.limit - region.cursor));
+		region.cursor = mapHugeAligned(hugeRegionSize);
+		region.limit = region.cursor + hugeRegionSize;
+	}
+
+	auto address = region.cursor;
+	region.cursor += length;
+	return address;
+}
+
+uintptr_t mapPages(size_t length) {
+	if(__atomic_load_n(&useHugePages, __ATOMIC_RELAXED))
+		return mapHugePages(length);
+
+	void *ptr;
+	__ensure(!mlibc::sys_anon_allocate(length, &ptr));
+	return reinterpret_cast<uintptr_t>(ptr);
+}
+
+// --------------------------------------------------------
+// Arenas
+// --------------------------------------------------------
+
+// Each arena has its own central free lists and MemoryPool. Threads use the arena
+// of the CPU that they are running on, such that contention scales with the number
+// of cores rather than with the number of threads.
+// Blocks from runs can be returned to any arena; MemoryPool blocks are returned
+// to the arena that allocated them (which is found through the page map).
+constexpr size_t maxArenas = 64;
+static_assert(maxArenas <= directPage);
+
+struct CentralBin {
+	FutexLock lock;
+	FreeBlock *list = nullptr;
+	FreeSpan *spans = nullptr;
+	// Part of the current run (or span) that was not handed out yet.
+	uintptr_t runCursor = 0;
+	uintptr_t runLimit = 0;
+
+	// Statistics; protected by the lock.
+	size_t listCount = 0;
+	size_t spanBytes = 0;
+	size_t runsMapped = 0;
+	size_t contended = 0;
+};
+
+// Holds the lock of a bin and counts acquisitions that had to wait for another thread.
+struct BinGuard {
+	BinGuard(CentralBin &central)
+	: _central{central} {
+		if(!central.lock.try_lock()) {
+			central.lock.lock();
+			central.contended++;
+		}
+	}
+
+	BinGuard(const BinGuard &) = delete;
+
+	BinGuard &operator= (const BinGuard &) = delete;
+
+	~BinGuard() {
+		_central.lock.unlock();
+	}
+
+private:
+	CentralBin &_central;
+};
+
+struct Arena {
+	Arena(unsigned int index)
+	: virtualAllocator{index}, heap{virtualAllocator}, pool{&heap} { }
+
+	CentralBin bins[numBins];
+	VirtualAllocator virtualAllocator;
+	MemoryPool heap;
+	frg::slab_allocator<VirtualAllocator, FutexLock> pool;
+
+	// Number of centralPut() calls, used to decide when to check for purging.
+	unsigned int putCount = 0;
+
+	// Number and usable size of the MemoryPool blocks of this arena.
+	size_t largeCount = 0;
+	size_t largeBytes = 0;
+};
+
+// Arenas other than the first one are only created by configureAllocator().
+constinit Arena *extraArenas[maxArenas] {};
+constinit size_t numArenas = 1;
+
+Arena &getArena(size_t index) {
+	if(!index) {
+		// See getAllocator() for why frg::eternal is used here.
+		static frg::eternal<Arena> firstArena{0u};
+		return firstArena.get();
+	}
+	return *extraArenas[index];
+}
+
+size_t currentArena() {
+	auto n = __atomic_load_n(&numArenas, __ATOMIC_ACQUIRE);
+	if(n == 1)
+		return 0;
+
+#if __MLIBC_LINUX_OPTION
+	int cpu;
+	if(mlibc::sys_getcpu && !mlibc::sys_getcpu(&cpu))
+		return cpu % n;
+#endif
+	return mlibc::this_tid() % n;
+}
+
+// Maximal number of free list entries that are inspected to find an aligned block.
+constexpr size_t maxAlignedScan = 64;
+
+bool isAligned(void *ptr, size_t align) {
+	return !(reinterpret_cast<uintptr_t>(ptr) & (align - 1));
+}
+
+// Carves the next block out of the current run of a bin (mapping a new run if necessary).
+// The lock of the bin must be held.
+FreeBlock *carveBlock(CentralBin &central, size_t bin) {
+	if(central.runCursor == central.runLimit) {
+		if(auto span = central.spans; span) {
+			central.spans = span->next;
+			central.runCursor = reinterpret_cast<uintptr_t>(span);
+			central.runLimit = span->limit;
+			central.spanBytes -= central.runLimit - central.runCursor;
+		}else{
+			auto run = mapPages(runSize);
+			pageMap.set(run, runSize, runPage(bin));
+			central.runCursor = run;
+			central.runLimit = run + runSize;
+			central.runsMapped++;
+		}
+	}
+	auto block = reinterpret_cast<FreeBlock *>(central.runCursor);
+	central.runCursor += binSize(bin);
+	return block;
+}
+
+// Takes up to n blocks from the central list of the given bin and chains them together.
+// Returns the number of blocks that were obtained.
+size_t centralTake(size_t arena, size_t bin, size_t n, FreeBlock **head) {
+	auto &central = getArena(arena).bins[bin];
+	BinGuard guard{central};
+
+	size_t k = 0;
+	FreeBlock *chain = nullptr;
+	while(k < n && central.list) {
+		auto block = central.list;
+		central.list = block->next;
+		block->next = chain;
+		chain = block;
+		k++;
+	}
+	central.listCount -= k;
+
+	while(k < n) {
+		auto block = carveBlock(central, bin);
+		block->next = chain;
+		chain = block;
+		k++;
+	}
+
+	*head = chain;
+	return k;
+}
+
+// Takes a block whose address is a multiple of align from the central list of the given bin.
+// Blocks that are carved out of the run to reach an aligned address are put on the central list.
+FreeBlock *centralTakeAligned(size_t arena, size_t bin, size_t align) {
+	auto &central = getArena(arena).bins[bin];
+	BinGuard guard{central};
+
+	auto link = &central.list;
+	for(size_t i = 0; *link && i < maxAlignedScan; i++) {
+		if(isAligned(*link, align)) {
+			auto block = *link;
+			*link = block->next;
+			central.listCount--;
+			return block;
+		}
+		link = &(*link)->next;
+	}
+
+	// Runs are page aligned, hence this terminates after at most align / binSize(bin) blocks.
+	while(true) {
+		auto block = carveBlock(central, bin);
+		if(isAligned(block, align))
+			return block;
+		block->next = central.list;
+		central.list = block;
+		central.listCount++;
+	}
+}
+
+// --------------------------------------------------------
+// Purging
+// --------------------------------------------------------
+
+// Free pages of the central lists are handed back to the OS by purgeAll().
+// This happens on malloc_trim() and, if purgeInterval is non-zero, whenever
+// purgeInterval nanoseconds have passed since the last purge.
+constinit uint64_t purgeInterval = 0;
+
+// Number of centralPut() calls between checks of the clock.
+constexpr unsigned int purgeCheckPeriod = 16;
+
+// Purging is throttled such that it takes at most 1 / purgeCostFactor of the time.
+constexpr uint64_t purgeCostFactor = 16;
+
+// Total number of bytes that were purged so far.
+constinit size_t purgedBytes = 0;
+
+FreeBlock *mergeBlocks(FreeBlock *a, FreeBlock *b) {
+	FreeBlock *head;
+	auto tail = &head;
+	while(a && b) {
+		if(a < b) {
+			*tail = a;
+			a = a->next;
+		}else{
+			*tail = b;
+			b = b->next;
+		}
+		tail = &(*tail)->next;
+	}
+	*tail = a ? a : b;
+	return head;
+}
+
+// Sorts a list of blocks by address (using a bottom-up merge sort).
+FreeBlock *sortBlocks(FreeBlock *list) {
+	FreeBlock *partial[sizeof(uintptr_t) * CHAR_BIT] {};
+	while(list) {
+		auto carry = list;
+		list = list->next;
+		carry->next = nullptr;
+
+		size_t i = 0;
+		for(; partial[i]; i++) {
+			carry = mergeBlocks(partial[i], carry);
+			partial[i] = nullptr;
+		}
+		partial[i] = carry;
+	}
+
+	FreeBlock *sorted = nullptr;
+	for(auto p : partial)
+		sorted = mergeBlocks(p, sorted);
+	return sorted;
+}
+
+// Turns all ranges of at least two free pages of a bin into spans and purges them.
+// As blocks migrate between arenas, the free lists of all arenas are considered together;
+// afterwards, the remaining blocks and the spans are distributed evenly among the arenas.
+// Returns the number of bytes that were purged.
+size_t purgeBin(size_t bin, bool lazy) {
+	auto size = binSize(bin);
+	auto n = __atomic_load_n(&numArenas, __ATOMIC_ACQUIRE);
+
+	// No other code path holds more than one bin lock at a time,
+	// hence taking the locks of all arenas in order cannot deadlock.
+	FreeBlock *list = nullptr;
+	for(size_t i = 0; i < n; i++) {
+		auto &central = getArena(i).bins[bin];
+		central.lock.lock();
+		central.listCount = 0;
+		if(central.list) {
+			auto last = central.list;
+			while(last->next)
+				last = last->next;
+			last->next = list;
+			list = central.list;
+			central.list = nullptr;
+		}
+	}
+
+	// The remaining blocks are relinked in address order.
+	FreeBlock *head = nullptr;
+	auto tail = &head;
+	size_t count = 0;
+	auto append = [&] (uintptr_t address) {
+		auto block = reinterpret_cast<FreeBlock *>(address);
+		*tail = block;
+		tail = &block->next;
+		count++;
+	};
+
+	size_t purged = 0;
+	size_t spans = 0;
+	auto block = sortBlocks(list);
+	while(block) {
+		// Find a maximal sequence of adjacent blocks.
+		auto last = block;
+		size_t k = 1;
+		while(last->next && reinterpret_cast<uintptr_t>(last->next) == reinterpret_cast<uintptr_t>(last) + size) {
+			last = last->next;
+			k++;
+		}
+		auto rest = last->next;
+
+		auto start = reinterpret_cast<uintptr_t>(block);
+		auto end = reinterpret_cast<uintptr_t>(last) + size;
+		auto spanStart = (start + pageSize - 1) & ~(pageSize - 1);
+		auto spanEnd = end & ~(pageSize - 1);
+
+		if(spanEnd > spanStart + pageSize) {
+			for(auto address = start; address < spanStart; address += size)
+				append(address);
+			for(auto address = spanEnd; address < end; address += size)
+				append(address);
+
+			// The first page stays resident as it stores the span itself.
+			VirtualAllocator::purge(spanStart + pageSize, spanEnd - spanStart - pageSize, lazy);
+			auto &central = getArena(spans++ % n).bins[bin];
+			auto span = reinterpret_cast<FreeSpan *>(spanStart);
+			span->next = central.spans;
+			span->limit = spanEnd;
+			central.spans = span;
+			central.spanBytes += spanEnd - spanStart;
+			purged += spanEnd - spanStart - pageSize;
+		}else{
+			*tail = block;
+			tail = &last->next;
+			count += k;
+		}
+		block = rest;
+	}
+	*tail = nullptr;
+
+	for(size_t i = 0; i < n; i++) {
+		auto &central = getArena(i).bins[bin];
+		auto share = count / (n - i);
+		if(share) {
+			auto last = head;
+			for(size_t j = 1; j < share; j++)
+				last = last->next;
+			central.list = head;
+			central.listCount = share;
+			head = last->next;
+			last->next = nullptr;
+			count -= share;
+		}
+		central.lock.unlock();
+	}
+	__atomic_fetch_add(&purgedBytes, purged, __ATOMIC_RELAXED);
+	return purged;
+}
+
+size_t purgeAll(bool lazy) {
+	size_t purged = 0;
+	for(size_t bin = 0; bin < numBins; bin++)
+		purged += purgeBin(bin, lazy);
+	return purged;
+}
+
+#if !MLIBC_BUILDING_RTLD
+uint64_t currentTime() {
+	time_t secs;
+	long nanos;
+	if(mlibc::sys_clock_get(CLOCK_MONOTONIC, &secs, &nanos))
+		return 0;
+	return static_cast<uint64_t>(secs) * 1'000'000'000 + nanos;
+}
+
+// Time (in nanoseconds) at which the next purge is due, or UINT64_MAX while purging.
+constinit uint64_t nextPurge = 0;
+#endif
+
+void maybePurge(Arena &arena) {
+#if !MLIBC_BUILDING_RTLD
+	if(!purgeInterval)
+		return;
+	if(__atomic_add_fetch(&arena.putCount, 1, __ATOMIC_RELAXED) % purgeCheckPeriod)
+		return;
+
+	auto now = currentTime();
+	auto next = __atomic_load_n(&nextPurge, __ATOMIC_RELAXED);
+	if(now < next)
+		return;
+	// Only one thread purges at a time.
+	if(!__atomic_compare_exchange_n(&nextPurge, &next, UINT64_MAX,
+			false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return;
+
+	purgeAll(true);
+
+	auto end = currentTime();
+	__atomic_store_n(&nextPurge, end + frg::max(purgeInterval, (end - now) * purgeCostFactor),
+			__ATOMIC_RELAXED);
+#else
+	(void)arena;
+#endif
+}
+
+// Returns a chain of n blocks (that ends in tail) to the central list of the given bin.
+void centralPut(size_t arena, size_t bin, FreeBlock *head, FreeBlock *tail, size_t n) {
+	auto &central = getArena(arena).bins[bin];
+	{
+		BinGuard guard{central};
+		tail->next = central.list;
+		central.list = head;
+		central.listCount += n;
+	}
+	maybePurge(getArena(arena));
+}
+
+// --------------------------------------------------------
+// Thread caches
+// --------------------------------------------------------
+
+struct ThreadCache {
+	struct Bin {
+		FreeBlock *list;
+		size_t count;
+	};
+
+	Bin bins[numBins];
+
+	// Link in the list of all caches.
+	ThreadCache *prev;
+	ThreadCache *next;
+
+	// State of allocation sampling, see sampleSmall().
+	unsigned int sampleCountdown;
+	uint32_t sampleSeed;
+};
+
+static_assert(sizeof(ThreadCache) <= smallLimit);
+
+// All live thread caches, such that statistics can account for the blocks that they hold.
+struct CacheRegistry {
+	FutexLock lock;
+	ThreadCache *head = nullptr;
+};
+
+CacheRegistry &getCacheRegistry() {
+	static frg::eternal<CacheRegistry> registry;
+	return registry.get();
+}
+
+void registerCache(ThreadCache *cache) {
+	auto &registry = getCacheRegistry();
+	frg::unique_lock lock(registry.lock);
+	cache->prev = nullptr;
+	cache->next = registry.head;
+	if(registry.head)
+		registry.head->prev = cache;
+	registry.head = cache;
+}
+
+void unregisterCache(ThreadCache *cache) {
+	auto &registry = getCacheRegistry();
+	frg::unique_lock lock(registry.lock);
+	if(cache->prev)
+		cache->prev->next = cache->next;
+	else
+		registry.head = cache->next;
+	if(cache->next)
+		cache->next->prev = cache->prev;
+}
+
+// Stored in Tcb::allocatorCache once the thread has drained its cache on exit.
+// Later allocations of that thread bypass the cache.
+void *const drainedCache = reinterpret_cast<void *>(uintptr_t{1});
+
+ThreadCache *currentCache() {
+#if !MLIBC_BUILDING_RTLD
+	// The RTLD uses its own heap and is single-threaded; only libc uses thread caches.
+	if(!mlibc::tcb_available_flag)
+		return nullptr;
+
+	auto tcb = mlibc::get_current_tcb();
+	if(tcb->allocatorCache == drainedCache)
+		return nullptr;
+	if(!tcb->allocatorCache) {
+		// The cache itself is taken from the central lists directly.
+		FreeBlock *block;
+		__ensure(centralTake(currentArena(), sizeToBin(sizeof(ThreadCache)), 1, &block) == 1);
+		memset(block, 0, sizeof(ThreadCache));
+		registerCache(reinterpret_cast<ThreadCache *>(block));
+		tcb->allocatorCache = block;
+	}
+	return static_cast<ThreadCache *>(tcb->allocatorCache);
+#else
+	return nullptr;
+#endif
+}
+
+// Moves the first n blocks of a thread cache bin back to the central list.
+void flushBin(ThreadCache *cache, size_t bin, size_t n) {
+	auto &local = cache->bins[bin];
+	__ensure(n && n <= local.count);
+
+	auto head = local.list;
+	auto tail = head;
+	for(size_t i = 1; i < n; i++)
+		tail = tail->next;
+	local.list = tail->next;
+	local.count -= n;
+
+	centralPut(currentArena(), bin, head, tail, n);
+}
+
+// Moves all blocks of a thread cache back to the central lists.
+void flushCache(ThreadCache *cache) {
+	for(size_t bin = 0; bin < numBins; bin++) {
+		if(cache->bins[bin].count)
+			flushBin(cache, bin, cache->bins[bin].count);
+	}
+}
+
+void *allocateSmall(size_t bin) {
+	auto cache = currentCache();
+	if(!cache) {
+		FreeBlock *block;
+		__ensure(centralTake(currentArena(), bin, 1, &block) == 1);
+		return block;
+	}
+
+	auto &local = cache->bins[bin];
+	if(!local.list)
+		local.count = centralTake(currentArena(), bin, binBatch(bin), &local.list);
+
+	auto block = local.list;
+	local.list = block->next;
+	local.count--;
+	return block;
+}
+
+// Allocates a block of the given bin that is aligned to align (which exceeds the bin size).
+// Since runs are carved sequentially, suitably aligned blocks are usually found
+// among the cached or free blocks; no block is rounded up to the alignment.
+void *allocateSmallAligned(size_t bin, size_t align) {
+	if(auto cache = currentCache(); cache) {
+		auto &local = cache->bins[bin];
+		for(auto link = &local.list; *link; link = &(*link)->next) {
+			if(isAligned(*link, align)) {
+				auto block = *link;
+				*link = block->next;
+				local.count--;
+				return block;
+			}
+		}
+	}
+	return centralTakeAligned(currentArena(), bin, align);
+}
+
+void freeSmall(void *ptr, size_t bin) {
+	auto block = static_cast<FreeBlock *>(ptr);
+
+	auto cache = currentCache();
+	if(!cache) {
+		centralPut(currentArena(), bin, block, block, 1);
+		return;
+	}
+
+	auto &local = cache->bins[bin];
+	block->next = local.list;
+	local.list = block;
+	if(++local.count > binLimit(bin))
+		flushBin(cache, bin, binBatch(bin));
+}
+
+// --------------------------------------------------------
+// Direct mappings
+// --------------------------------------------------------
+
+// Allocations with an alignment above the page size, large zeroed allocations and
+// blocks that are grown by realloc() beyond directLimit are mapped directly.
+// Resizing such a mapping only moves page table entries, not the contents.
+// For large alignments, the mapping is over-sized to find an
+// aligned address, and the excess is unmapped again right away.
+// The page in front of the block records the length of the mapping.
+// Thus, the overhead is a single page, independently of the alignment.
+
+// Zeroed allocations of at least this size are mapped directly, as fresh
+// anonymous memory is already zero and does not need to be touched.
+// Likewise, blocks that are reallocated to at least this size are moved to a direct mapping.
+constexpr size_t directLimit = 0x20000;
+
+struct DirectHeader {
+	size_t length;
+};
+
+// Number and total length of all direct mappings.
+constinit size_t directCount = 0;
+constinit size_t directBytes = 0;
+
+// Returns zeroed memory that is aligned to align (which is at least the page size).
+void *mapDirect(size_t size, size_t align) {
+	__ensure(align >= pageSize);
+	if(size > SIZE_MAX - align - 2 * pageSize)
+		return nullptr;
+	size_t length = pageSize + ((size + pageSize - 1) & ~(pageSize - 1));
+	size_t slack = align - pageSize;
+
+	void *ptr;
+	if(mlibc::sys_anon_allocate(length + slack, &ptr))
+		return nullptr;
+	auto raw = reinterpret_cast<uintptr_t>(ptr);
+	auto base = ((raw + pageSize + align - 1) & ~(align - 1)) - pageSize;
+
+	if(base != raw)
+		__ensure(!mlibc::sys_anon_free(ptr, base - raw));
+	if(auto tail = raw + length + slack - (base + length); tail)
+		__ensure(!mlibc::sys_anon_free(reinterpret_cast<void *>(base + length), tail));
+
+	if(length >= hugePageSize && __atomic_load_n(&useHugePages, __ATOMIC_RELAXED))
+		adviseHuge(base, length);
+
+	pageMap.set(base, length, directPage);
+	reinterpret_cast<DirectHeader *>(base)->length = length;
+	__atomic_fetch_add(&directCount, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&directBytes, length, __ATOMIC_RELAXED);
+	return reinterpret_cast<void *>(base + pageSize);
+}
+
+DirectHeader *directHeader(void *ptr) {
+	return reinterpret_cast<DirectHeader *>(reinterpret_cast<uintptr_t>(ptr) - pageSize);
+}
+
+void unmapDirect(void *ptr) {
+	auto header = directHeader(ptr);
+	auto base = reinterpret_cast<uintptr_t>(header);
+	auto length = header->length;
+	__atomic_fetch_sub(&directCount, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&directBytes, length, __ATOMIC_RELAXED);
+	pageMap.set(base, length, 0);
+	__ensure(!mlibc::sys_anon_free(header, length));
+}
+
+// Resizes a direct mapping, possibly moving it to a different address.
+// Returns nullptr if the mapping cannot be resized.
+void *remapDirect(void *ptr, size_t size) {
+#if __MLIBC_POSIX_OPTION
+	if(!mlibc::sys_vm_remap || size > SIZE_MAX - 2 * pageSize)
+		return nullptr;
+
+	auto header = directHeader(ptr);
+	auto base = reinterpret_cast<uintptr_t>(header);
+	auto length = header->length;
+	size_t newLength = pageSize + ((size + pageSize - 1) & ~(pageSize - 1));
+	if(newLength == length)
+		return ptr;
+
+	// The old pages can be reused by other mappings as soon as they are remapped.
+	pageMap.set(base, length, 0);
+	void *window;
+	if(mlibc::sys_vm_remap(header, length, newLength, &window)) {
+		pageMap.set(base, length, directPage);
+		return nullptr;
+	}
+
+	auto newBase = reinterpret_cast<uintptr_t>(window);
+	pageMap.set(newBase, newLength, directPage);
+	static_cast<DirectHeader *>(window)->length = newLength;
+	__atomic_fetch_add(&directBytes, newLength - length, __ATOMIC_RELAXED);
+	return reinterpret_cast<void *>(newBase + pageSize);
+#else
+	(void)ptr;
+	(void)size;
+	return nullptr;
+#endif
+}
+
+uint8_t lookupBlock(void *ptr) {
+	return pageMap.lookup(reinterpret_cast<uintptr_t>(ptr));
+}
+
+// Returns the arena whose MemoryPool a block that is not part of a run belongs to.
+Arena &owningArena(uint8_t entry) {
+	return getArena(entry & ~poolPageBit);
+}
+
+// MemoryPool blocks are accounted by their usable size.
+void *allocateLarge(Arena &arena, size_t size) {
+	auto p = arena.pool.allocate(size);
+	if(p) {
+		__atomic_fetch_add(&arena.largeCount, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&arena.largeBytes, arena.pool.get_size(p), __ATOMIC_RELAXED);
+	}
+	return p;
+}
+
+void unaccountLarge(Arena &arena, void *ptr) {
+	__atomic_fetch_sub(&arena.largeCount, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&arena.largeBytes, arena.pool.get_size(ptr), __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------
+// Sampled allocations
+// --------------------------------------------------------
+
+// If sampling is enabled, about one in sampleRate small allocations is placed into a
+// slot of a guarded pool instead. Every slot is a page between two inaccessible guard
+// pages, and blocks are placed at the end of their slot such that overflows fault
+// immediately. Freed slots are made inaccessible, hence accesses to freed blocks
+// fault as well. Such faults are reported by a SIGSEGV handler; corruption of the
+// remainder of a slot is detected when the block is freed.
+constexpr size_t numSampledSlots = 256;
+constexpr size_t sampledPoolSize = (2 * numSampledSlots + 1) * pageSize;
+
+// Fills the parts of a slot that are not covered by its block.
+constexpr unsigned char sampledFill = 0xAB;
+
+constinit size_t sampleRate = 0;
+constinit uintptr_t sampledBase = 0;
+constinit uintptr_t sampledLimit = 0;
+
+struct SampledSlot {
+	uintptr_t block;
+	size_t size;
+	bool allocated;
+};
+
+struct SampledPool {
+	FutexLock lock;
+	SampledSlot slots[numSampledSlots] = {};
+	// Slots are reused in round-robin order, such that freed slots stay
+	// inaccessible for as long as possible.
+	size_t cursor = 0;
+};
+
+SampledPool &getSampledPool() {
+	static frg::eternal<SampledPool> pool;
+	return pool.get();
+}
+
+bool isSampled(void *ptr) {
+	auto address = reinterpret_cast<uintptr_t>(ptr);
+	return address >= sampledBase && address < sampledLimit;
+}
+
+uintptr_t slotAddress(size_t slot) {
+	return sampledBase + (2 * slot + 1) * pageSize;
+}
+
+// Number of small allocations until the next one is sampled; picked at random
+// such that the sampled allocations do not follow the allocation pattern.
+unsigned int nextSampleCountdown(ThreadCache *cache) {
+	if(!cache->sampleSeed)
+		cache->sampleSeed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(cache) >> 4) | 1;
+	auto x = cache->sampleSeed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	cache->sampleSeed = x;
+	return 1 + x % (2 * sampleRate - 1);
+}
+
+void *allocateSampled(size_t size) {
+	auto &pool = getSampledPool();
+	uintptr_t slot;
+	uintptr_t block;
+	{
+		frg::unique_lock lock(pool.lock);
+		size_t i = 0;
+		for(; i < numSampledSlots; i++) {
+			if(!pool.slots[(pool.cursor + i) % numSampledSlots].allocated)
+				break;
+		}
+		// If all slots are in use, the allocation is not sampled.
+		if(i == numSampledSlots)
+			return nullptr;
+		auto index = (pool.cursor + i) % numSampledSlots;
+		pool.cursor = index + 1;
+
+		slot = slotAddress(index);
+		block = slot + pageSize - ((size + binSize(0) - 1) & ~(binSize(0) - 1));
+		pool.slots[index] = {block, size, true};
+	}
+
+	__ensure(!mlibc::sys_vm_protect(reinterpret_cast<void *>(slot), pageSize,
+			PROT_READ | PROT_WRITE));
+	memset(reinterpret_cast<void *>(slot), sampledFill, pageSize);
+	return reinterpret_cast<void *>(block);
+}
+
+void *sampleSmall(size_t size) {
+	auto cache = currentCache();
+	if(!cache)
+		return nullptr;
+
+	auto countdown = cache->sampleCountdown;
+	cache->sampleCountdown = countdown > 1 ? countdown - 1 : nextSampleCountdown(cache);
+	if(countdown != 1)
+		return nullptr;
+	return allocateSampled(size);
+}
+
+SampledSlot &sampledSlot(void *ptr) {
+	auto page = (reinterpret_cast<uintptr_t>(ptr) - sampledBase) / pageSize;
+	if(!(page & 1))
+		mlibc::panicLogger() << "mlibc: free() of invalid pointer " << ptr
+				<< " (guard page of sampled allocations)" << frg::endlog;
+	return getSampledPool().slots[page / 2];
+}
+
+size_t sampledSize(void *ptr) {
+	return sampledSlot(ptr).size;
+}
+
+void freeSampled(void *ptr) {
+	auto &pool = getSampledPool();
+	auto &slot = sampledSlot(ptr);
+	auto address = reinterpret_cast<uintptr_t>(ptr);
+	auto start = address & ~(pageSize - 1);
+
+	// The lock is held until the slot is inaccessible again, such that it cannot be reused before.
+	frg::unique_lock lock(pool.lock);
+	if(!slot.allocated)
+		mlibc::panicLogger() << "mlibc: double free of sampled block " << ptr
+				<< " (size " << slot.size << ")" << frg::endlog;
+	if(slot.block != address)
+		mlibc::panicLogger() << "mlibc: free() of invalid pointer " << ptr
+				<< " (inside of sampled block " << (void *)slot.block
+				<< " of size " << slot.size << ")" << frg::endlog;
+
+	auto bytes = reinterpret_cast<unsigned char *>(start);
+	for(uintptr_t p = start; p < start + pageSize; p++) {
+		if(p >= slot.block && p < slot.block + slot.size)
+			continue;
+		if(bytes[p - start] == sampledFill)
+			continue;
+		mlibc::panicLogger() << "mlibc: heap corruption detected at " << (void *)p
+				<< (p < slot.block ? " before" : " after") << " sampled block " << ptr
+				<< " of size " << slot.size << frg::endlog;
+	}
+
+	__ensure(!mlibc::sys_vm_protect(reinterpret_cast<void *>(start), pageSize, PROT_NONE));
+	slot.allocated = false;
+}
+
+#if __MLIBC_POSIX_OPTION && !MLIBC_BUILDING_RTLD
+struct sigaction previousSegvAction;
+
+// Reports faults within the pool of sampled allocations; other faults are
+// forwarded to the handler that was installed before.
+void handleSampledFault(int sig, siginfo_t *info, void *context) {
+	auto address = reinterpret_cast<uintptr_t>(info->si_addr);
+	if(address < sampledBase || address >= sampledLimit) {
+		if(previousSegvAction.sa_flags & SA_SIGINFO) {
+			previousSegvAction.sa_sigaction(sig, info, context);
+			return;
+		}
+		if(previousSegvAction.sa_handler != SIG_DFL && previousSegvAction.sa_handler != SIG_IGN) {
+			previousSegvAction.sa_handler(sig);
+			return;
+		}
+		// Returning retries the access, which then faults with the default action.
+		mlibc::sys_sigaction(SIGSEGV, &previousSegvAction, nullptr);
+		return;
+	}
+
+	// Slots are read without taking the lock; the faulting thread may hold it.
+	auto page = (address - sampledBase) / pageSize;
+	auto &pool = getSampledPool();
+	if(page & 1) {
+		auto &slot = pool.slots[page / 2];
+		mlibc::infoLogger() << "mlibc: use-after-free at " << info->si_addr
+				<< " in sampled block " << (void *)slot.block
+				<< " of size " << slot.size << frg::endlog;
+	}else if(page && address - sampledBase < pageSize * page + pageSize / 2) {
+		// The first half of a guard page belongs to the slot before it.
+		auto &slot = pool.slots[page / 2 - 1];
+		mlibc::infoLogger() << "mlibc: heap-buffer-overflow at " << info->si_addr << ", "
+				<< (address - slot.block - slot.size) << " bytes after sampled block "
+				<< (void *)slot.block << " of size " << slot.size << frg::endlog;
+	}else if(page / 2 < numSampledSlots) {
+		auto &slot = pool.slots[page / 2];
+		mlibc::infoLogger() << "mlibc: heap-buffer-underflow at " << info->si_addr << ", "
+				<< (slot.block - address) << " bytes before sampled block "
+				<< (void *)slot.block << " of size " << slot.size << frg::endlog;
+	}else{
+		mlibc::infoLogger() << "mlibc: invalid access at " << info->si_addr
+				<< " near sampled allocations" << frg::endlog;
+	}
+
+	struct sigaction action{};
+	action.sa_handler = SIG_DFL;
+	mlibc::sys_sigaction(SIGSEGV, &action, nullptr);
+}
+
+void enableSampling(unsigned int rate) {
+	if(!rate || sampledBase || !mlibc::sys_vm_protect || !mlibc::sys_sigaction)
+		return;
+
+	void *pool;
+	if(mlibc::sys_vm_map(nullptr, sampledPoolSize, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0, &pool))
+		return;
+
+	struct sigaction action{};
+	action.sa_sigaction = handleSampledFault;
+	action.sa_flags = SA_SIGINFO;
+	if(mlibc::sys_sigaction(SIGSEGV, &action, &previousSegvAction)) {
+		__ensure(!mlibc::sys_vm_unmap(pool, sampledPoolSize));
+		return;
+	}
+
+	sampledBase = reinterpret_cast<uintptr_t>(pool);
+	sampledLimit = sampledBase + sampledPoolSize;
+	__atomic_store_n(&sampleRate, rate, __ATOMIC_RELEASE);
+}
+#endif
+
+} // namespace anonymous
+
 // --------------------------------------------------------
 // Globals
 // --------------------------------------------------------
@@ -16,26 +1161,306 @@
 MemoryAllocator &getAllocator() {
 	// use frg::eternal to prevent a call to __cxa_atexit().
 	// this is necessary because __cxa_atexit() call this function.
-	static frg::eternal<VirtualAllocator> virtualAllocator;
-	static frg::eternal<MemoryPool> heap{virtualAllocator.get()};
-	static frg::eternal<MemoryAllocator> singleton{&heap.get()};
+	static frg::eternal<MemoryAllocator> singleton{};
 	return singleton.get();
 }
 
+void drainThreadCache() {
+#if !MLIBC_BUILDING_RTLD
+	auto tcb = mlibc::get_current_tcb();
+	if(!tcb->allocatorCache || tcb->allocatorCache == drainedCache) {
+		tcb->allocatorCache = drainedCache;
+		return;
+	}
+
+	auto cache = static_cast<ThreadCache *>(tcb->allocatorCache);
+	unregisterCache(cache);
+	flushCache(cache);
+
+	tcb->allocatorCache = drainedCache;
+	freeSmall(cache, sizeToBin(sizeof(ThreadCache)));
+#endif
+}
+
+#if !MLIBC_BUILDING_RTLD
+void configureAllocator(const mlibc::GlobalConfig &config) {
+	size_t n = frg::min(frg::max(size_t{config.mallocArenas}, size_t{1}), maxArenas);
+	for(size_t i = numArenas; i < n; i++) {
+		void *storage;
+		__ensure(!mlibc::sys_anon_allocate(sizeof(Arena), &storage));
+		extraArenas[i] = new (storage) Arena{static_cast<unsigned int>(i)};
+	}
+
+	purgeInterval = uint64_t{config.mallocDecayMs} * 1'000'000;
+	__atomic_store_n(&useHugePages, config.mallocHugePages, __ATOMIC_RELAXED);
+#if __MLIBC_POSIX_OPTION
+	enableSampling(config.mallocSampleRate);
+#endif
+	nextPurge = currentTime() + purgeInterval;
+
+	if(n > numArenas)
+		__atomic_store_n(&numArenas, n, __ATOMIC_RELEASE);
+}
+#endif
+
+// --------------------------------------------------------
+// MemoryAllocator
+// --------------------------------------------------------
+
+void *MemoryAllocator::allocate(size_t size) {
+	if(size && size <= smallLimit) {
+		if(__builtin_expect(sampleRate != 0, 0)) {
+			if(auto p = sampleSmall(size); p)
+				return p;
+		}
+		return allocateSmall(sizeToBin(size));
+	}
+	return allocateLarge(getArena(currentArena()), size);
+}
+
+void *MemoryAllocator::allocate_zeroed(size_t size) {
+	if(size >= directLimit)
+		return mapDirect(size, pageSize);
+
+	auto p = allocate(size);
+	if(p)
+		memset(p, 0, size);
+	return p;
+}
+
+void *MemoryAllocator::allocate_aligned(size_t size, size_t align) {
+	__ensure(!(align & (align - 1)));
+	// All blocks are aligned to at least the smallest size class.
+	if(align <= binSize(0))
+		return allocate(size);
+
+	if(size <= smallLimit && align <= smallLimit) {
+		auto bin = sizeToBin(size);
+		if(binSize(bin) >= align)
+			return allocateSmall(bin);
+		return allocateSmallAligned(bin, align);
+	}
+
+	if(align > pageSize)
+		return mapDirect(size, align);
+
+	// The MemoryPool aligns blocks of power-of-two size naturally, and larger blocks
+	// to pages; hence this wastes less than a page.
+	auto p = allocateLarge(getArena(currentArena()), frg::max(size, align));
+	__ensure(!p || isAligned(p, align));
+	return p;
+}
+
+void MemoryAllocator::free(void *ptr) {
+	if(!ptr)
+		return;
+	if(isSampled(ptr)) {
+		freeSampled(ptr);
+		return;
+	}
+
+	auto entry = lookupBlock(ptr);
+	if(auto bin = entryBin(entry); bin >= 0) {
+		freeSmall(ptr, bin);
+		return;
+	}
+	if(entry == directPage) {
+		unmapDirect(ptr);
+		return;
+	}
+	auto &arena = owningArena(entry);
+	unaccountLarge(arena, ptr);
+	arena.pool.free(ptr);
+}
+
+void MemoryAllocator::deallocate(void *ptr, size_t size) {
+	if(!ptr)
+		return;
+	if(isSampled(ptr)) {
+		freeSampled(ptr);
+		return;
+	}
+
+	// Small blocks always belong to the bin of their size (reallocate() maintains this),
+	// hence the page map lookup can be skipped.
+	if(size && size <= smallLimit) {
+		freeSmall(ptr, sizeToBin(size));
+		return;
+	}
+
+	auto entry = lookupBlock(ptr);
+	if(auto bin = entryBin(entry); bin >= 0) {
+		freeSmall(ptr, bin);
+		return;
+	}
+	if(entry == directPage) {
+		unmapDirect(ptr);
+		return;
+	}
+	auto &arena = owningArena(entry);
+	unaccountLarge(arena, ptr);
+	arena.pool.deallocate(ptr, size);
+}
+
+void MemoryAllocator::deallocate_aligned(void *ptr, size_t size, size_t align) {
+	// allocate_aligned() serves small sizes from the bin of their size unless the
+	// alignment exceeds smallLimit.
+	if(align > smallLimit) {
+		free(ptr);
+		return;
+	}
+	deallocate(ptr, size);
+}
+
+void *MemoryAllocator::reallocate(void *ptr, size_t size) {
+	if(!ptr)
+		return allocate(size);
+	if(!size) {
+		free(ptr);
+		return nullptr;
+	}
+
+	if(isSampled(ptr)) {
+		auto newArea = allocate(size);
+		if(!newArea)
+			return nullptr;
+		memcpy(newArea, ptr, frg::min(sampledSize(ptr), size));
+		freeSampled(ptr);
+		return newArea;
+	}
+
+	auto entry = lookupBlock(ptr);
+	auto bin = entryBin(entry);
+	if(entry == directPage && size > smallLimit) {
+		if(auto newArea = remapDirect(ptr, size); newArea)
+			return newArea;
+	}else if(bin < 0 && size > smallLimit && size < directLimit) {
+		auto &arena = owningArena(entry);
+		auto oldSize = arena.pool.get_size(ptr);
+		auto newArea = arena.pool.reallocate(ptr, size);
+		if(newArea)
+			__atomic_fetch_add(&arena.largeBytes, arena.pool.get_size(newArea) - oldSize, __ATOMIC_RELAXED);
+		return newArea;
+	}
+
+	// Only keep the block if it is in the bin of the new size,
+	// such that sized deallocation with the new size finds the right bin.
+	if(bin >= 0 && size <= smallLimit && sizeToBin(size) == static_cast<size_t>(bin))
+		return ptr;
+
+	// Once a block grows large, move it to a direct mapping such that
+	// further growth does not need to copy it.
+	auto newArea = size >= directLimit ? mapDirect(size, pageSize) : allocate(size);
+	if(!newArea)
+		return nullptr;
+	memcpy(newArea, ptr, frg::min(get_size(ptr), size));
+	free(ptr);
+	return newArea;
+}
+
+size_t MemoryAllocator::trim() {
+	if(auto cache = currentCache(); cache)
+		flushCache(cache);
+
+	return purgeAll(false);
+}
+
+size_t MemoryAllocator::get_size(void *ptr) {
+	if(isSampled(ptr))
+		return sampledSize(ptr);
+
+	auto entry = lookupBlock(ptr);
+	if(auto bin = entryBin(entry); bin >= 0)
+		return binSize(bin);
+	if(entry == directPage)
+		return directHeader(ptr)->length - pageSize;
+	return owningArena(entry).pool.get_size(ptr);
+}
+
+void MemoryAllocator::get_stats(AllocatorStats &stats) {
+	memset(&stats, 0, sizeof(AllocatorStats));
+
+	size_t cached[numBins] {};
+	{
+		auto &registry = getCacheRegistry();
+		frg::unique_lock lock(registry.lock);
+		for(auto cache = registry.head; cache; cache = cache->next) {
+			// The owning thread updates its counts without synchronization;
+			// a slightly stale value is fine here.
+			for(size_t bin = 0; bin < numBins; bin++)
+				cached[bin] += __atomic_load_n(&cache->bins[bin].count, __ATOMIC_RELAXED);
+		}
+	}
+
+	static_assert(numBins <= AllocatorStats::maxSizeClasses);
+	stats.numSizeClasses = numBins;
+
+	auto n = __atomic_load_n(&numArenas, __ATOMIC_ACQUIRE);
+	for(size_t bin = 0; bin < numBins; bin++) {
+		auto &sizeClass = stats.sizeClasses[bin];
+		sizeClass.blockSize = binSize(bin);
+		sizeClass.cachedBytes = cached[bin] * binSize(bin);
+
+		for(size_t i = 0; i < n; i++) {
+			auto &central = getArena(i).bins[bin];
+			frg::unique_lock lock(central.lock);
+			sizeClass.mappedBytes += central.runsMapped * runSize;
+			sizeClass.freeBytes += central.listCount * binSize(bin) + central.spanBytes
+					+ (central.runLimit - central.runCursor);
+			sizeClass.contendedLocks += central.contended;
+		}
+
+		auto unused = sizeClass.freeBytes + sizeClass.cachedBytes;
+		if(sizeClass.mappedBytes > unused)
+			sizeClass.inUseBytes = sizeClass.mappedBytes - unused;
+	}
+
+	for(size_t i = 0; i < n; i++) {
+		auto &arena = getArena(i);
+		stats.largeCount += __atomic_load_n(&arena.largeCount, __ATOMIC_RELAXED);
+		stats.largeBytes += __atomic_load_n(&arena.largeBytes, __ATOMIC_RELAXED);
+	}
+
+	stats.directCount = __atomic_load_n(&directCount, __ATOMIC_RELAXED);
+	stats.directBytes = __atomic_load_n(&directBytes, __ATOMIC_RELAXED);
+	stats.purgedBytes = __atomic_load_n(&purgedBytes, __ATOMIC_RELAXED);
+}
+
 // --------------------------------------------------------
 // VirtualAllocator
 // --------------------------------------------------------
 
 uintptr_t VirtualAllocator::map(size_t length) {
-	void *ptr;
-	__ensure(!mlibc::sys_anon_allocate(length, &ptr));
-	return (uintptr_t)ptr;
+	auto address = mapPages(length);
+	if(_arena)
+		pageMap.set(address, length, poolPage(_arena));
+	return address;
 }
 
 void VirtualAllocator::unmap(uintptr_t address, size_t length) {
+	if(_arena)
+		pageMap.set(address, length, 0);
 	__ensure(!mlibc::sys_anon_free((void *)address, length));
 }
 
+void VirtualAllocator::purge(uintptr_t address, size_t length, bool lazy) {
+#if __MLIBC_POSIX_OPTION
+	if(!mlibc::sys_madvise)
+		return;
+#ifdef MADV_FREE
+	if(lazy && !mlibc::sys_madvise((void *)address, length, MADV_FREE))
+		return;
+#endif
+#ifdef MADV_DONTNEED
+	mlibc::sys_madvise((void *)address, length, MADV_DONTNEED);
+#endif
+#else
+	(void)address;
+	(void)length;
+	(void)lazy;
+#endif
+}
+
 #else
 
 namespace {
@@ -71,29 +1496,61 @@ constexpr uint8_t alignmentAreaValue = 'C';
 // Remaining area within the metadata page after the metadata.
 constexpr uint8_t metaAreaValue = 'D';
 
-// Alignment of the returned memory.
-// TODO(qookie): Eventually accept alignment as an argument of allocate.
+// Default alignment of the returned memory.
 constexpr size_t pointerAlignment = 16;
 
-// TODO(qookie): Support this. Perhaps by overallocating by 2x and then picking
-// an offset that guarantees the desired alignment.
 static_assert(pointerAlignment <= 4096, "Pointer aligment of more than 4096 bytes is unsupported");
 static_assert(!(pointerAlignment & (pointerAlignment - 1)),
 		"Pointer aligment must be a power of 2");
 
 constexpr size_t pageSize = 0x1000;
 
+// Number and total length of the mappings of live allocations.
+constinit size_t liveCount = 0;
+constinit size_t liveBytes = 0;
+
 void *MemoryAllocator::allocate(size_t size) {
+	return allocate_aligned(size, pointerAlignment);
+}
+
+void *MemoryAllocator::allocate_zeroed(size_t size) {
+	void *ptr = allocate(size);
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+void *MemoryAllocator::allocate_aligned(size_t size, size_t align) {
+	__ensure(!(align & (align - 1)));
+	align = frg::max(align, pointerAlignment);
+
 	size_t pg_size = (size + size_t{pageSize - 1}) & ~size_t{pageSize - 1};
-	size_t offset = (pg_size - size) & ~size_t{pointerAlignment - 1};
+	size_t offset = (pg_size - size) & ~size_t{frg::min(align, pageSize) - 1};
+	// Alignments above the page size are satisfied by reserving more address space
+	// and picking an aligned page from it; the excess is released again below.
+	size_t slack = align > pageSize ? align : 0;
 
 	void *ptr;
 
 	// Two extra pages for metadata in front and guard page at the end
 	// Reserve the whole region as PROT_NONE...
-	if (int e = mlibc::sys_vm_map(nullptr, pg_size + pageSize * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0, &ptr))
+	if (int e = mlibc::sys_vm_map(nullptr, pg_size + pageSize * 2 + slack, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0, &ptr))
 		mlibc::panicLogger() << "sys_vm_map failed in MemoryAllocator::allocate (errno " << e << ")" << frg::endlog;
 
+	if (slack) {
+		uintptr_t reserved = reinterpret_cast<uintptr_t>(ptr);
+		uintptr_t start = ((reserved + pageSize + align - 1) & ~(align - 1)) - pageSize;
+		uintptr_t end = start + pg_size + pageSize * 2;
+
+		if (start != reserved)
+			if (int e = mlibc::sys_vm_unmap(ptr, start - reserved))
+				mlibc::panicLogger() << "sys_vm_unmap failed in MemoryAllocator::allocate (errno " << e << ")" << frg::endlog;
+		if (end != reserved + pg_size + pageSize * 2 + slack)
+			if (int e = mlibc::sys_vm_unmap(reinterpret_cast<void *>(end), reserved + pg_size + pageSize * 2 + slack - end))
+				mlibc::panicLogger() << "sys_vm_unmap failed in MemoryAllocator::allocate (errno " << e << ")" << frg::endlog;
+
+		ptr = reinterpret_cast<void *>(start);
+	}
+
 	// ...Then replace pages to make them accessible, excluding the guard page
 	if (int e = mlibc::sys_vm_map(ptr, pg_size + pageSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, -1, 0, &ptr))
 		mlibc::panicLogger() << "sys_vm_map failed in MemoryAllocator::allocate (errno " << e << ")" << frg::endlog;
@@ -104,6 +1561,8 @@ void *MemoryAllocator::allocate(size_t size) {
 	void *out_align_area = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(out) + size);
 
 	AllocatorMeta metaData{size, pg_size, allocatorMagic};
+	__atomic_fetch_add(&liveCount, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&liveBytes, pg_size + pageSize * 2, __ATOMIC_RELAXED);
 
 	memset(meta, metaAreaValue, pageSize);
 	memcpy(meta, &metaData, sizeof(AllocatorMeta));
@@ -150,6 +1609,9 @@ void MemoryAllocator::deallocate(void *ptr, size_t size) {
 	if (size != meta->allocatedSize)
 		mlibc::panicLogger() << "Invalid allocated size in metadata in MemoryAllocator::deallocate (given " << size << ", stored " << meta->allocatedSize << ")" << frg::endlog;
 
+	__atomic_fetch_sub(&liveCount, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&liveBytes, meta->pagesSize + pageSize * 2, __ATOMIC_RELAXED);
+
 	if constexpr (neverReleaseVa) {
 		void *unused;
 		if (int e = mlibc::sys_vm_map(meta, meta->pagesSize + pageSize * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, -1, 0, &unused))
@@ -160,6 +1622,10 @@ void MemoryAllocator::deallocate(void *ptr, size_t size) {
 	}
 }
 
+void MemoryAllocator::deallocate_aligned(void *ptr, size_t size, size_t) {
+	deallocate(ptr, size);
+}
+
 void *MemoryAllocator::reallocate(void *ptr, size_t size) {
 	if (!size) {
 		free(ptr);
@@ -206,4 +1672,26 @@ MemoryAllocator &getAllocator() {
 	return singleton.get();
 }
 
+size_t MemoryAllocator::trim() {
+	// Freed memory is unmapped immediately.
+	return 0;
+}
+
+void MemoryAllocator::get_stats(AllocatorStats &stats) {
+	// Every allocation is a separate mapping.
+	memset(&stats, 0, sizeof(AllocatorStats));
+	stats.directCount = __atomic_load_n(&liveCount, __ATOMIC_RELAXED);
+	stats.directBytes = __atomic_load_n(&liveBytes, __ATOMIC_RELAXED);
+}
+
+void drainThreadCache() {
+	// The debug allocator does not cache anything.
+}
+
+#if !MLIBC_BUILDING_RTLD
+void configureAllocator(const mlibc::GlobalConfig &) {
+	// The debug allocator has no tunables.
+}
+#endif
+
 #endif /* !MLIBC_DEBUG_ALLOCATOR */
@@ -88,6 +88,10 @@ namespace {
 #endif // __LP64__ / !__LP64__
 }
 
+// libc.so on x86_64 selects SIMD versions of memcpy(), memmove() and memset() at load time,
+// see options/internal/x86_64/essential.cpp.
+#if !(defined(__x86_64__) && !MLIBC_BUILDING_RTLD && !MLIBC_STATIC_BUILD)
+
 // --------------------------------------------------------------------------------------
 // memcpy() implementation.
 // --------------------------------------------------------------------------------------
@@ -207,6 +211,8 @@ void *memmove(void *dest, const void *src, size_t size) {
 	return dest;
 }
 
+#endif // !(__x86_64__ && !MLIBC_BUILDING_RTLD && !MLIBC_STATIC_BUILD)
+
 size_t strlen(const char *s) {
 	size_t len = 0;
 	for(size_t i = 0; s[i]; i++)
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <mlibc/allocator.hpp>
 #include <mlibc/global-config.hpp>
 
 namespace mlibc {
@@ -12,7 +13,7 @@ GlobalConfigGuard guard;
 
 GlobalConfigGuard::GlobalConfigGuard() {
 	// Force the config to be created during initialization of libc.so.
-	mlibc::globalConfig();
+	configureAllocator(mlibc::globalConfig());
 }
 
 static bool envEnabled(const char *env) {
@@ -20,8 +21,19 @@ static bool envEnabled(const char *env) {
 	return value && *value && *value != '0';
 }
 
+static unsigned int envUnsigned(const char *env, unsigned int fallback) {
+	auto value = getenv(env);
+	if(!value || !*value)
+		return fallback;
+	return strtoul(value, nullptr, 10);
+}
+
 GlobalConfig::GlobalConfig() {
 	debugMalloc = envEnabled("MLIBC_DEBUG_MALLOC");
+	mallocArenas = envUnsigned("MLIBC_MALLOC_ARENAS", 1);
+	mallocDecayMs = envUnsigned("MLIBC_MALLOC_DECAY_MS", 10000);
+	mallocHugePages = envEnabled("MLIBC_MALLOC_HUGEPAGES");
+	mallocSampleRate = envUnsigned("MLIBC_MALLOC_SAMPLE_RATE", 0);
 }
 
 }
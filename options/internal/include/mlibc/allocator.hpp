@@ -10,29 +10,85 @@
 
 struct VirtualAllocator {
 public:
+	VirtualAllocator(unsigned int arena = 0)
+	: _arena{arena} { }
+
 	uintptr_t map(size_t length);
 
 	void unmap(uintptr_t address, size_t length);
+
+	// Releases the backing memory of the range; its contents become undefined.
+	// Lazy purges let the OS reclaim the memory only under memory pressure.
+	static void purge(uintptr_t address, size_t length, bool lazy);
+
+private:
+	unsigned int _arena;
 };
 
 typedef frg::slab_pool<VirtualAllocator, FutexLock> MemoryPool;
 
-typedef frg::slab_allocator<VirtualAllocator, FutexLock> MemoryAllocator;
+#endif // !MLIBC_DEBUG_ALLOCATOR
 
-MemoryAllocator &getAllocator();
+// Snapshot of the allocator's counters, see MemoryAllocator::get_stats().
+struct AllocatorStats {
+	static constexpr size_t maxSizeClasses = 16;
+
+	struct SizeClass {
+		size_t blockSize;
+		// Memory that was mapped for blocks of this size class.
+		size_t mappedBytes;
+		// Blocks that are allocated by the program.
+		size_t inUseBytes;
+		// Free blocks that are held by thread caches.
+		size_t cachedBytes;
+		// Free blocks in the central lists (including space that was never handed out).
+		size_t freeBytes;
+		// Number of times that a thread had to wait for the lock of a central list.
+		size_t contendedLocks;
+	};
 
-#else
+	size_t numSizeClasses;
+	SizeClass sizeClasses[maxSizeClasses];
 
+	// Allocations that are served by the MemoryPool.
+	size_t largeCount;
+	size_t largeBytes;
+
+	// Allocations that are mapped directly.
+	size_t directCount;
+	size_t directBytes;
+
+	// Memory that was returned to the OS by purging so far.
+	size_t purgedBytes;
+};
+
+// Small allocations are served from per-thread caches that are refilled from
+// (and flushed to) per-size-class free lists; larger allocations go to a MemoryPool.
+// Both the free lists and the pools are sharded into per-CPU arenas.
+// With the debug allocator, every allocation is a separate mapping.
 struct MemoryAllocator {
 	void *allocate(size_t size);
+	void *allocate_zeroed(size_t size);
+	// Alignment must be a power of two.
+	void *allocate_aligned(size_t size, size_t align);
 	void free(void *ptr);
+	// Size (and alignment) must be the ones that the block was allocated with.
 	void deallocate(void *ptr, size_t size);
+	void deallocate_aligned(void *ptr, size_t size, size_t align);
 	void *reallocate(void *ptr, size_t size);
 	size_t get_size(void *ptr);
+	// Returns free memory to the OS; returns the number of bytes released.
+	size_t trim();
+	void get_stats(AllocatorStats &stats);
 };
 
 MemoryAllocator &getAllocator();
 
-#endif // !MLIBC_DEBUG_ALLOCATOR
+namespace mlibc {
+	struct GlobalConfig;
+}
+
+// Applies the allocator tunables of the GlobalConfig; called once during libc initialization.
+void configureAllocator(const mlibc::GlobalConfig &config);
 
 #endif // MLIBC_FRIGG_ALLOC
@@ -7,6 +7,14 @@ struct GlobalConfig {
 	GlobalConfig();
 	
 	bool debugMalloc;
+	// Number of per-CPU allocator arenas.
+	unsigned int mallocArenas;
+	// Interval (in milliseconds) after which free allocator pages are purged; zero disables purging.
+	unsigned int mallocDecayMs;
+	// Back the allocator by transparent huge pages.
+	bool mallocHugePages;
+	// About one in mallocSampleRate small allocations is guarded by inaccessible pages; zero disables sampling.
+	unsigned int mallocSampleRate;
 };
 
 inline const GlobalConfig &globalConfig() {
@@ -81,6 +81,9 @@ namespace mlibc {
 #endif
 }
 
+// Returns the blocks cached by the calling thread to the allocator.
+void drainThreadCache();
+
 enum class TcbThreadReturnValue {
 	Pointer,
 	Integer,
@@ -138,6 +141,9 @@ struct Tcb {
 	void *stackAddr;
 	size_t guardSize;
 
+	// Per-thread cache of the allocator, see options/internal/generic/allocator.cpp.
+	void *allocatorCache;
+
 	inline void invokeThreadFunc(void *entry, void *user_arg) {
 		if(returnValueType == TcbThreadReturnValue::Pointer) {
 			auto func = reinterpret_cast<void *(*)(void *)>(entry);
@@ -146,6 +152,9 @@ struct Tcb {
 			auto func = reinterpret_cast<int (*)(void *)>(entry);
 			returnValue.intVal = func(user_arg);
 		}
+
+		// The thread is about to exit.
+		drainThreadCache();
 	}
 };
 
@@ -168,22 +177,22 @@ static_assert(offsetof(Tcb, cancelBits) == 0x18);
 #elif defined(__aarch64__)
 // The thread pointer on AArch64 points to 16 bytes before the end of the TCB.
 // options/linker/aarch64/runtime.S uses the offset of dtvPointers.
-static_assert(sizeof(Tcb) - offsetof(Tcb, dtvPointers) - TP_TCB_OFFSET == 104);
+static_assert(sizeof(Tcb) - offsetof(Tcb, dtvPointers) - TP_TCB_OFFSET == 112);
 // sysdeps/linux/aarch64/cp_syscall.S uses the offset of cancelBits.
-static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) - TP_TCB_OFFSET == 80);
+static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) - TP_TCB_OFFSET == 88);
 #elif defined(__riscv) && __riscv_xlen == 64
 // The thread pointer on RISC-V points to *after* the TCB, and since
 // we need to access specific fields that means that the value in
 // sysdeps/linux/riscv64/cp_syscall.S needs to be updated whenever
 // the struct is expanded.
-static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) == 96);
+static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) == 104);
 #elif defined (__m68k__)
 // The thread pointer on m68k points to 0x7000 bytes *after* the end of the
 // TCB, so similarly to as on RISC-V, we need to keep the value in
 // sysdeps/linux/m68k/cp_syscall.S up-to-date.
-static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) == 0x30);
+static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) == 0x34);
 #elif defined(__loongarch64)
-static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) == 96);
+static_assert(sizeof(Tcb) - offsetof(Tcb, cancelBits) == 104);
 #else
 #error "Missing architecture specific code."
 #endif
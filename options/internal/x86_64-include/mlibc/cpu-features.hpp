@@ -0,0 +1,64 @@
+#ifndef MLIBC_CPU_FEATURES_HPP
+#define MLIBC_CPU_FEATURES_HPP
+
+#include <stdint.h>
+
+namespace mlibc {
+
+struct CpuFeatures {
+	bool sse42;
+	bool avx2;
+	// AVX-512 foundation and byte/word instructions.
+	bool avx512;
+	// Enhanced rep movsb / rep stosb.
+	bool erms;
+	// Fast short rep movsb.
+	bool fsrm;
+};
+
+namespace detail {
+	inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *regs) {
+		asm volatile ("cpuid"
+				: "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+				: "a"(leaf), "c"(subleaf));
+	}
+
+	inline uint64_t xgetbv(uint32_t index) {
+		uint32_t lo, hi;
+		asm volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+		return (static_cast<uint64_t>(hi) << 32) | lo;
+	}
+} // namespace detail
+
+// Queries CPUID directly; usable from IRELATIVE resolvers, which run before libc is initialized.
+inline CpuFeatures detectCpuFeatures() {
+	CpuFeatures features{};
+	uint32_t regs[4];
+
+	detail::cpuid(0, 0, regs);
+	auto maxLeaf = regs[0];
+
+	detail::cpuid(1, 0, regs);
+	features.sse42 = regs[2] & (1 << 20);
+	bool osxsave = regs[2] & (1 << 27);
+	bool avx = regs[2] & (1 << 28);
+
+	// The OS has to save the YMM (and ZMM) state on context switches.
+	uint64_t xcr0 = osxsave ? detail::xgetbv(0) : 0;
+	bool ymmState = (xcr0 & 0x6) == 0x6;
+	bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+	if(maxLeaf >= 7) {
+		detail::cpuid(7, 0, regs);
+		features.avx2 = avx && ymmState && (regs[1] & (1 << 5));
+		features.avx512 = features.avx2 && zmmState
+				&& (regs[1] & (1 << 16)) && (regs[1] & (1 << 30));
+		features.erms = regs[1] & (1 << 9);
+		features.fsrm = regs[3] & (1 << 4);
+	}
+	return features;
+}
+
+} // namespace mlibc
+
+#endif // MLIBC_CPU_FEATURES_HPP
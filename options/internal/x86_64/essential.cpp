@@ -0,0 +1,333 @@
+#include <string.h>
+#include <stdint.h>
+
+#include <mlibc/cpu-features.hpp>
+
+// SIMD versions of memcpy(), memmove() and memset() for libc.so; the RTLD and static
+// builds use the generic implementations. The version that suits the CPU is selected
+// once by IRELATIVE resolvers when libc.so is relocated.
+
+#ifndef MLIBC_STATIC_BUILD
+
+namespace {
+	typedef long long Vec16 __attribute__((vector_size(16), aligned(1), may_alias));
+	typedef long long Vec32 __attribute__((vector_size(32), aligned(1), may_alias));
+	typedef long long Vec64 __attribute__((vector_size(64), aligned(1), may_alias));
+
+	template<typename T>
+	[[gnu::always_inline]]
+	inline T &at(unsigned char *p) {
+		return *reinterpret_cast<T *>(p);
+	}
+
+	template<typename T>
+	[[gnu::always_inline]]
+	inline const T &at(const unsigned char *p) {
+		return *reinterpret_cast<const T *>(p);
+	}
+
+	// Copies above these sizes use rep movsb / rep stosb; set by the resolvers.
+	constinit size_t repMovsbThreshold = SIZE_MAX;
+	constinit size_t repStosbThreshold = SIZE_MAX;
+
+	// Moves n <= W bytes. All loads happen before the first store, hence the ranges may overlap.
+	template<size_t W>
+	[[gnu::always_inline]]
+	inline void moveSmall(unsigned char *d, const unsigned char *s, size_t n) {
+		if constexpr (W > 32) {
+			if(n >= 32) {
+				Vec32 a = at<Vec32>(s);
+				Vec32 b = at<Vec32>(s + n - 32);
+				at<Vec32>(d) = a;
+				at<Vec32>(d + n - 32) = b;
+				return;
+			}
+		}
+		if(n >= 16) {
+			Vec16 a = at<Vec16>(s);
+			Vec16 b = at<Vec16>(s + n - 16);
+			at<Vec16>(d) = a;
+			at<Vec16>(d + n - 16) = b;
+		}else if(n >= 8) {
+			uint64_t a = at<uint64_t>(s);
+			uint64_t b = at<uint64_t>(s + n - 8);
+			at<uint64_t>(d) = a;
+			at<uint64_t>(d + n - 8) = b;
+		}else if(n >= 4) {
+			uint32_t a = at<uint32_t>(s);
+			uint32_t b = at<uint32_t>(s + n - 4);
+			at<uint32_t>(d) = a;
+			at<uint32_t>(d + n - 4) = b;
+		}else if(n >= 2) {
+			uint16_t a = at<uint16_t>(s);
+			uint16_t b = at<uint16_t>(s + n - 2);
+			at<uint16_t>(d) = a;
+			at<uint16_t>(d + n - 2) = b;
+		}else if(n) {
+			*d = *s;
+		}
+	}
+
+	template<typename V>
+	[[gnu::always_inline]]
+	inline void *move(void *dest, const void *src, size_t n) {
+		constexpr size_t w = sizeof(V);
+		auto d = static_cast<unsigned char *>(dest);
+		auto s = static_cast<const unsigned char *>(src);
+
+		if(n <= w) {
+			moveSmall<w>(d, s, n);
+			return dest;
+		}
+		if(n <= 2 * w) {
+			V a = at<V>(s);
+			V b = at<V>(s + n - w);
+			at<V>(d) = a;
+			at<V>(d + n - w) = b;
+			return dest;
+		}
+		if(n <= 4 * w) {
+			V a = at<V>(s);
+			V b = at<V>(s + w);
+			V c = at<V>(s + n - 2 * w);
+			V e = at<V>(s + n - w);
+			at<V>(d) = a;
+			at<V>(d + w) = b;
+			at<V>(d + n - 2 * w) = c;
+			at<V>(d + n - w) = e;
+			return dest;
+		}
+
+		// Unsigned differences: the copy can run forwards unless d lies within [s, s + n).
+		auto forward = uintptr_t(d) - uintptr_t(s) >= n;
+		if(n >= repMovsbThreshold && forward && uintptr_t(s) - uintptr_t(d) >= n) {
+			asm volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+			return dest;
+		}
+
+		// The first and last vectors are loaded up front and stored last, such that
+		// the loop only needs to handle aligned destinations and whole blocks.
+		if(forward) {
+			V head = at<V>(s);
+			V t0 = at<V>(s + n - 4 * w);
+			V t1 = at<V>(s + n - 3 * w);
+			V t2 = at<V>(s + n - 2 * w);
+			V t3 = at<V>(s + n - w);
+			auto end = d + n;
+
+			size_t skew = w - (uintptr_t(d) & (w - 1));
+			auto cd = d + skew;
+			auto cs = s + skew;
+			size_t rem = n - skew;
+			while(rem > 4 * w) {
+				V a = at<V>(cs);
+				V b = at<V>(cs + w);
+				V c = at<V>(cs + 2 * w);
+				V e = at<V>(cs + 3 * w);
+				at<V>(cd) = a;
+				at<V>(cd + w) = b;
+				at<V>(cd + 2 * w) = c;
+				at<V>(cd + 3 * w) = e;
+				cd += 4 * w;
+				cs += 4 * w;
+				rem -= 4 * w;
+			}
+
+			at<V>(end - 4 * w) = t0;
+			at<V>(end - 3 * w) = t1;
+			at<V>(end - 2 * w) = t2;
+			at<V>(end - w) = t3;
+			at<V>(d) = head;
+		}else{
+			V tail = at<V>(s + n - w);
+			V h0 = at<V>(s);
+			V h1 = at<V>(s + w);
+			V h2 = at<V>(s + 2 * w);
+			V h3 = at<V>(s + 3 * w);
+
+			size_t skew = uintptr_t(d + n) & (w - 1);
+			auto cd = d + n - skew;
+			auto cs = s + n - skew;
+			size_t rem = n - skew;
+			while(rem > 4 * w) {
+				V a = at<V>(cs - w);
+				V b = at<V>(cs - 2 * w);
+				V c = at<V>(cs - 3 * w);
+				V e = at<V>(cs - 4 * w);
+				at<V>(cd - w) = a;
+				at<V>(cd - 2 * w) = b;
+				at<V>(cd - 3 * w) = c;
+				at<V>(cd - 4 * w) = e;
+				cd -= 4 * w;
+				cs -= 4 * w;
+				rem -= 4 * w;
+			}
+
+			at<V>(d) = h0;
+			at<V>(d + w) = h1;
+			at<V>(d + 2 * w) = h2;
+			at<V>(d + 3 * w) = h3;
+			at<V>(d + n - w) = tail;
+		}
+		return dest;
+	}
+
+	template<typename V>
+	[[gnu::always_inline]]
+	inline void *set(void *dest, int c, size_t n) {
+		constexpr size_t w = sizeof(V);
+		auto d = static_cast<unsigned char *>(dest);
+		uint64_t pattern = 0x0101010101010101 * static_cast<unsigned char>(c);
+
+		if(n < 16) {
+			if(n >= 8) {
+				at<uint64_t>(d) = pattern;
+				at<uint64_t>(d + n - 8) = pattern;
+			}else if(n >= 4) {
+				at<uint32_t>(d) = pattern;
+				at<uint32_t>(d + n - 4) = pattern;
+			}else if(n >= 2) {
+				at<uint16_t>(d) = pattern;
+				at<uint16_t>(d + n - 2) = pattern;
+			}else if(n) {
+				*d = pattern;
+			}
+			return dest;
+		}
+
+		V v = V{} + static_cast<long long>(pattern);
+		if(n <= w) {
+			if constexpr (w > 32) {
+				if(n >= 32) {
+					Vec32 half = Vec32{} + static_cast<long long>(pattern);
+					at<Vec32>(d) = half;
+					at<Vec32>(d + n - 32) = half;
+					return dest;
+				}
+			}
+			Vec16 quarter = Vec16{} + static_cast<long long>(pattern);
+			at<Vec16>(d) = quarter;
+			at<Vec16>(d + n - 16) = quarter;
+			return dest;
+		}
+		if(n <= 2 * w) {
+			at<V>(d) = v;
+			at<V>(d + n - w) = v;
+			return dest;
+		}
+		if(n <= 4 * w) {
+			at<V>(d) = v;
+			at<V>(d + w) = v;
+			at<V>(d + n - 2 * w) = v;
+			at<V>(d + n - w) = v;
+			return dest;
+		}
+
+		if(n >= repStosbThreshold) {
+			asm volatile ("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+			return dest;
+		}
+
+		auto end = d + n;
+		at<V>(d) = v;
+		auto cd = reinterpret_cast<unsigned char *>((uintptr_t(d) + w) & ~(w - 1));
+		while(static_cast<size_t>(end - cd) > 4 * w) {
+			at<V>(cd) = v;
+			at<V>(cd + w) = v;
+			at<V>(cd + 2 * w) = v;
+			at<V>(cd + 3 * w) = v;
+			cd += 4 * w;
+		}
+		at<V>(end - 4 * w) = v;
+		at<V>(end - 3 * w) = v;
+		at<V>(end - 2 * w) = v;
+		at<V>(end - w) = v;
+		return dest;
+	}
+
+	void *memmoveSse2(void *dest, const void *src, size_t n) {
+		return move<Vec16>(dest, src, n);
+	}
+
+	[[gnu::target("avx2")]]
+	void *memmoveAvx2(void *dest, const void *src, size_t n) {
+		return move<Vec32>(dest, src, n);
+	}
+
+	[[gnu::target("avx512f,avx512bw")]]
+	void *memmoveAvx512(void *dest, const void *src, size_t n) {
+		return move<Vec64>(dest, src, n);
+	}
+
+	void *memsetSse2(void *dest, int c, size_t n) {
+		return set<Vec16>(dest, c, n);
+	}
+
+	[[gnu::target("avx2")]]
+	void *memsetAvx2(void *dest, int c, size_t n) {
+		return set<Vec32>(dest, c, n);
+	}
+
+	[[gnu::target("avx512f,avx512bw")]]
+	void *memsetAvx512(void *dest, int c, size_t n) {
+		return set<Vec64>(dest, c, n);
+	}
+
+	using MemmoveFn = void *(*)(void *, const void *, size_t);
+	using MemsetFn = void *(*)(void *, int, size_t);
+} // namespace anonymous
+
+// Resolvers run while libc.so is being relocated; they may only rely on CPUID.
+extern "C" [[gnu::visibility("hidden")]] MemmoveFn __mlibc_resolve_memmove() {
+	auto features = mlibc::detectCpuFeatures();
+	if(features.erms)
+		repMovsbThreshold = 2048;
+
+	if(features.avx512) {
+		if(features.erms)
+			repMovsbThreshold = 2048 * 4;
+		return memmoveAvx512;
+	}
+	if(features.avx2) {
+		if(features.erms)
+			repMovsbThreshold = 2048 * 2;
+		return memmoveAvx2;
+	}
+	return memmoveSse2;
+}
+
+extern "C" [[gnu::visibility("hidden")]] MemsetFn __mlibc_resolve_memset() {
+	auto features = mlibc::detectCpuFeatures();
+	if(features.erms)
+		repStosbThreshold = 2048;
+
+	if(features.avx512)
+		return memsetAvx512;
+	if(features.avx2)
+		return memsetAvx2;
+	return memsetSse2;
+}
+
+// Calls to these go through the GOT, which is filled by R_X86_64_IRELATIVE relocations.
+extern "C" [[gnu::visibility("hidden")]] void *__mlibc_memmove(void *dest, const void *src, size_t n)
+	__attribute__((ifunc("__mlibc_resolve_memmove")));
+extern "C" [[gnu::visibility("hidden")]] void *__mlibc_memset(void *dest, int c, size_t n)
+	__attribute__((ifunc("__mlibc_resolve_memset")));
+
+// --------------------------------------------------------------------------------------
+// Exported entry points.
+// --------------------------------------------------------------------------------------
+
+void *memcpy(void *__restrict dest, const void *__restrict src, size_t n) {
+	return __mlibc_memmove(dest, src, n);
+}
+
+void *memmove(void *dest, const void *src, size_t n) {
+	return __mlibc_memmove(dest, src, n);
+}
+
+void *memset(void *dest, int c, size_t n) {
+	return __mlibc_memset(dest, c, n);
+}
+
+#endif // !MLIBC_STATIC_BUILD
@@ -1,7 +1,31 @@
 #include <bits/ensure.h>
+#include <errno.h>
 #include <malloc.h>
+#include <stdint.h>
 
-void *memalign(size_t, size_t) {
-	__ensure(!"Not implemented");
-	__builtin_unreachable();
+#include <mlibc/allocator.hpp>
+#include <mlibc/arch-defs.hpp>
+
+void *memalign(size_t alignment, size_t size) {
+	if(alignment & (alignment - 1)) {
+		errno = EINVAL;
+		return nullptr;
+	}
+
+	auto p = getAllocator().allocate_aligned(size, alignment);
+	if(!p)
+		errno = ENOMEM;
+	return p;
+}
+
+void *valloc(size_t size) {
+	return memalign(mlibc::page_size, size);
+}
+
+void *pvalloc(size_t size) {
+	if(size > SIZE_MAX - (mlibc::page_size - 1)) {
+		errno = ENOMEM;
+		return nullptr;
+	}
+	return memalign(mlibc::page_size, (size + mlibc::page_size - 1) & ~(mlibc::page_size - 1));
 }
@@ -17,6 +17,8 @@ void free(void *__pointer);
 void *malloc(size_t __size);
 void *realloc(void *__pointer, size_t __size);
 void *memalign(size_t __alignment, size_t __size);
+void *valloc(size_t __size);
+void *pvalloc(size_t __size);
 
 #if __MLIBC_GLIBC_OPTION
 #include <bits/glibc/glibc_malloc.h>
@@ -391,6 +391,8 @@ __attribute__ ((__noreturn__)) void pthread_exit(void *ret_val) {
 		}
 	}
 
+	drainThreadCache();
+
 	self->returnValue.voidPtr = ret_val;
 	__atomic_store_n(&self->didExit, 1, __ATOMIC_RELEASE);
 	mlibc::sys_futex_wake(&self->didExit);
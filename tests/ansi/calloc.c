@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 int main() {
 	errno = 0;
@@ -17,6 +18,24 @@ int main() {
 		size_t *p = ptr;
 		assert(!p[i]);
 	}
+	free(ptr);
+
+	// Reused memory must be zeroed, too.
+	size_t sizes[] = {24, 1000, 5000, 1 << 20, 8 << 20};
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		for(int round = 0; round < 2; round++) {
+			unsigned char *p = calloc(1, sizes[i]);
+			assert(p);
+			for(size_t j = 0; j < sizes[i]; j++)
+				assert(!p[j]);
+			memset(p, 0xFF, sizes[i]);
+
+			p = realloc(p, sizes[i] * 2);
+			assert(p);
+			assert(p[sizes[i] - 1] == 0xFF);
+			free(p);
+		}
+	}
 
 	return 0;
 }
@@ -0,0 +1,57 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main() {
+	size_t sizes[] = {1, 8, 16, 17, 100, 512, 1000, 1024, 1025, 4096, 100000, 1 << 20};
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		char *p = malloc(sizes[i]);
+		assert(p);
+		memset(p, 0x55, sizes[i]);
+		free_sized(p, sizes[i]);
+
+		p = calloc(1, sizes[i]);
+		assert(p);
+		free_sized(p, sizes[i]);
+	}
+
+	// realloc() to a small size must return a block that can be freed with that size.
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		char *p = malloc(sizes[i]);
+		assert(p);
+		memset(p, 0x55, sizes[i]);
+		p = realloc(p, 24);
+		assert(p);
+		for(size_t j = 0; j < 24 && j < sizes[i]; j++)
+			assert(p[j] == 0x55);
+		free_sized(p, 24);
+	}
+
+	size_t alignments[] = {1, 8, 16, 64, 256, 1024, 4096, 65536};
+	for(size_t i = 0; i < sizeof(alignments) / sizeof(*alignments); i++) {
+		for(size_t j = 0; j < sizeof(sizes) / sizeof(*sizes); j++) {
+			size_t size = (sizes[j] + alignments[i] - 1) & ~(alignments[i] - 1);
+			char *p = aligned_alloc(alignments[i], size);
+			assert(p);
+			assert(!((uintptr_t)p & (alignments[i] - 1)));
+			memset(p, 0x55, size);
+			free_aligned_sized(p, alignments[i], size);
+		}
+	}
+
+	free_sized(NULL, 16);
+	free_aligned_sized(NULL, 64, 64);
+
+	// Freed blocks must be reusable.
+	for(int round = 0; round < 1000; round++) {
+		void *a = malloc(48);
+		void *b = malloc(48);
+		assert(a && b && a != b);
+		free_sized(a, 48);
+		free_sized(b, 48);
+	}
+
+	return 0;
+}
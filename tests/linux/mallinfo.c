@@ -0,0 +1,40 @@
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT 1024
+
+static void *blocks[COUNT];
+
+int main() {
+	struct mallinfo2 before = mallinfo2();
+
+	for(size_t i = 0; i < COUNT; i++) {
+		blocks[i] = malloc(64);
+		assert(blocks[i]);
+		memset(blocks[i], 0, 64);
+	}
+	void *large = malloc(1 << 20);
+	assert(large);
+	memset(large, 0, 1 << 20);
+
+	struct mallinfo2 during = mallinfo2();
+	assert(during.uordblks + during.hblkhd >= before.uordblks + before.hblkhd + COUNT * 64);
+	assert(during.arena + during.hblkhd >= during.uordblks);
+
+	assert(malloc_info(0, stdout) == 0);
+	assert(malloc_info(1, stdout) == EINVAL);
+	malloc_stats();
+
+	for(size_t i = 0; i < COUNT; i++)
+		free(blocks[i]);
+	free(large);
+
+	struct mallinfo2 after = mallinfo2();
+	assert(after.uordblks + after.hblkhd < during.uordblks + during.hblkhd);
+
+	return 0;
+}
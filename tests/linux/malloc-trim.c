@@ -0,0 +1,55 @@
+#include <assert.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT 16384
+
+static void *blocks[COUNT];
+
+int main() {
+	size_t sizes[] = {16, 64, 256, 1000};
+
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+		for(size_t i = 0; i < COUNT; i++) {
+			blocks[i] = malloc(sizes[s]);
+			assert(blocks[i]);
+			memset(blocks[i], (int)i, sizes[s]);
+		}
+
+		// Keep every 64th block alive; everything else can be released.
+		for(size_t i = 0; i < COUNT; i++) {
+			if(i % 64) {
+				free(blocks[i]);
+				blocks[i] = NULL;
+			}
+		}
+		malloc_trim(0);
+
+		for(size_t i = 0; i < COUNT; i += 64) {
+			unsigned char *p = blocks[i];
+			assert(p[0] == (unsigned char)i && p[sizes[s] - 1] == (unsigned char)i);
+		}
+
+		// Memory must be usable again after trimming.
+		for(size_t i = 0; i < COUNT; i++) {
+			if(blocks[i])
+				continue;
+			blocks[i] = malloc(sizes[s]);
+			assert(blocks[i]);
+			memset(blocks[i], 0xAA, sizes[s]);
+		}
+		for(size_t i = 0; i < COUNT; i++) {
+			unsigned char *p = blocks[i];
+			if(i % 64)
+				assert(p[0] == 0xAA && p[sizes[s] - 1] == 0xAA);
+			else
+				assert(p[0] == (unsigned char)i);
+			free(blocks[i]);
+		}
+	}
+
+	malloc_trim(0);
+	return 0;
+}
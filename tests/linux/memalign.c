@@ -0,0 +1,51 @@
+#include <assert.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void check(void *p, size_t align, size_t size) {
+	assert(p);
+	assert((uintptr_t)p % align == 0);
+	memset(p, 0xAB, size);
+}
+
+int main() {
+	size_t page = getpagesize();
+
+	size_t aligns[] = {16, 32, 64, 256, 1024, 4096, 16384, 1 << 21};
+	size_t sizes[] = {1, 16, 100, 1024, 3000, 65536};
+
+	for(size_t i = 0; i < sizeof(aligns) / sizeof(*aligns); i++) {
+		for(size_t j = 0; j < sizeof(sizes) / sizeof(*sizes); j++) {
+			void *p = memalign(aligns[i], sizes[j]);
+			check(p, aligns[i], sizes[j]);
+
+			// Blocks must remain usable with realloc().
+			p = realloc(p, sizes[j] * 2);
+			assert(p);
+			assert(((unsigned char *)p)[sizes[j] - 1] == 0xAB);
+			free(p);
+		}
+	}
+
+	// Keep a few small aligned blocks alive at once to exhaust the trivially aligned ones.
+	void *blocks[64];
+	for(size_t i = 0; i < 64; i++) {
+		blocks[i] = memalign(64, 16);
+		check(blocks[i], 64, 16);
+	}
+	for(size_t i = 0; i < 64; i++)
+		free(blocks[i]);
+
+	void *p = valloc(10);
+	check(p, page, 10);
+	free(p);
+
+	p = pvalloc(page + 1);
+	check(p, page, 2 * page);
+	free(p);
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// With MLIBC_MALLOC_SAMPLE_RATE=1, (almost) every small allocation is guarded.
+static void child(const char *mode) {
+	char *blocks[64];
+	for(int i = 0; i < 64; i++) {
+		blocks[i] = malloc(100);
+		assert(blocks[i]);
+		memset(blocks[i], i, 100);
+	}
+	for(int i = 0; i < 64; i++) {
+		for(int j = 0; j < 100; j++)
+			assert(blocks[i][j] == i);
+		blocks[i] = realloc(blocks[i], 50);
+		assert(blocks[i]);
+		assert(blocks[i][49] == i);
+	}
+	for(int i = 0; i < 63; i++)
+		free(blocks[i]);
+
+	volatile char *p = blocks[63];
+	if(!strcmp(mode, "overflow")) {
+		p[64] = 1;
+	}else if(!strcmp(mode, "use-after-free")) {
+		free(blocks[63]);
+		p[0] = 1;
+	}else{
+		free(blocks[63]);
+		exit(0);
+	}
+	exit(1);
+}
+
+static int run(char *self, char *mode) {
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if(!pid) {
+		char *argv[] = {self, mode, NULL};
+		char *envp[] = {"MLIBC_MALLOC_SAMPLE_RATE=1", NULL};
+		execve(self, argv, envp);
+		_exit(127);
+	}
+
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	return status;
+}
+
+int main(int argc, char **argv) {
+	if(argc > 1)
+		child(argv[1]);
+
+	int status = run(argv[0], "valid");
+	assert(WIFEXITED(status) && !WEXITSTATUS(status));
+
+	status = run(argv[0], "overflow");
+	assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+
+	status = run(argv[0], "use-after-free");
+	assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_THREADS 4
+#define NUM_BLOCKS 512
+
+static void *handoff[NUM_THREADS][NUM_BLOCKS];
+
+static size_t block_size(size_t i) {
+	return 1 + (i * 37) % 1500;
+}
+
+static void *worker(void *arg) {
+	uintptr_t id = (uintptr_t)arg;
+	void *local[NUM_BLOCKS];
+
+	for (int round = 0; round < 8; round++) {
+		for (size_t i = 0; i < NUM_BLOCKS; i++) {
+			local[i] = malloc(block_size(i));
+			assert(local[i]);
+			memset(local[i], (int)id, block_size(i));
+		}
+		for (size_t i = 0; i < NUM_BLOCKS; i++) {
+			unsigned char *p = local[i];
+			assert(p[0] == id && p[block_size(i) - 1] == id);
+			free(local[i]);
+		}
+	}
+
+	// These blocks are freed by the main thread after this thread exited.
+	for (size_t i = 0; i < NUM_BLOCKS; i++) {
+		handoff[id][i] = malloc(block_size(i));
+		assert(handoff[id][i]);
+		memset(handoff[id][i], (int)id, block_size(i));
+	}
+
+	if (id & 1)
+		pthread_exit(NULL);
+	return NULL;
+}
+
+int main() {
+	pthread_t threads[NUM_THREADS];
+
+	for (uintptr_t i = 0; i < NUM_THREADS; i++)
+		assert(!pthread_create(&threads[i], NULL, &worker, (void *)i));
+	for (size_t i = 0; i < NUM_THREADS; i++)
+		assert(!pthread_join(threads[i], NULL));
+
+	for (size_t t = 0; t < NUM_THREADS; t++) {
+		for (size_t i = 0; i < NUM_BLOCKS; i++) {
+			unsigned char *p = handoff[t][i];
+			assert(p[0] == t && p[block_size(i) - 1] == t);
+			free(p);
+		}
+	}
+
+	// Blocks that were cached by the exited threads must be reusable.
+	for (size_t i = 0; i < NUM_BLOCKS; i++) {
+		void *p = malloc(block_size(i));
+		assert(p);
+		free(p);
+	}
+
+	return 0;
+}